@@ -47,6 +47,10 @@ REFNAME=$TOOLSPATH/1000genomes/hs37d5
 INDELMILLS=$TOOLSPATH/variants/Mills_and_1000G_gold_standard.indels.b37.vcf
 DBSNP=$TOOLSPATH/variants/dbsnp_138.b37.vcf
 
+# optional quality score filter applied inline to the aligned SAM stream, e.g.
+# QSFILTER="$TOOLSPATH/genecodeq/pblock - 8" or QSFILTER="$TOOLSPATH/genecodeq/il8b convert -"
+QSFILTER=${QSFILTER:-cat}
+
 if [ "$#" -lt 5 ]
 then
     echo "A script to execute mapping to variant calls according to GATK guidelines"
@@ -101,8 +105,8 @@ BAMFILE=${OUTPUT}.bam
 
 date
 echo "Running BWA mem alignment..."
-$BWA mem -t8 -R"@RG\tID:${IDDESC}\tSM:NA12878\tPL:ILLUMINA" $REF ${PAIR0} | $SAMTOOLS view -b - -o ${BAMFILE}.up.bam
-$BWA mem -t8 -R"@RG\tID:${IDDESC}\tSM:NA12878\tPL:ILLUMINA" $REF ${PAIR1} ${PAIR2} | $SAMTOOLS view -b - -o ${BAMFILE}.p.bam
+$BWA mem -t8 -R"@RG\tID:${IDDESC}\tSM:NA12878\tPL:ILLUMINA" $REF ${PAIR0} | $QSFILTER | $SAMTOOLS view -b - -o ${BAMFILE}.up.bam
+$BWA mem -t8 -R"@RG\tID:${IDDESC}\tSM:NA12878\tPL:ILLUMINA" $REF ${PAIR1} ${PAIR2} | $QSFILTER | $SAMTOOLS view -b - -o ${BAMFILE}.p.bam
 
 date
 echo "BWA mem alignment completed. Running cleanup (samtools fixmate)..."
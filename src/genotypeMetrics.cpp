@@ -31,7 +31,13 @@
  *  genotypeMetrics - calculates genotyping accuracy metrics (Precision, Recall,
  *      F-score, ROC curves and ROC AUC) for VCF (variant calling format) files.
  *
- *  Uses a reference fasta file for canonicalising each indel variant.
+ *  Uses a reference fasta file for canonicalising each indel variant. The fasta
+ *  is accessed through its .fai index (samtools faidx), which is created next to
+ *  the fasta when missing. A 2-bit packed reference image written with the
+ *  packref command can be given in place of the fasta.
+ *
+ *  VCF files may be gzip or bgzip compressed, and can be restricted to the
+ *  regions of a BED file, using the tabix index of bgzipped files if present.
  *
  *  When operating on a single VCF file, it will only print Precision, Recall
  *  and F-score measures, as well as absolute numbers for set sizes.
@@ -52,6 +58,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <dirent.h>
 #include <string>
 #include <set>
 #include <vector>
@@ -64,568 +78,5703 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <errno.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <zlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define COMPARE_SNP   0
 #define COMPARE_INDEL 1
 #define COMPARE_ALL   2
 
-// Parse reference FA file
-class ParseRefFA {
-protected:
-    uint8_t *refSeq;
-    unsigned int refSeqSize;
-    std::map<std::string, uint64_t> chromStartPos;
+template <class Task>
+void parallelWorker(Task *task, std::atomic<unsigned int> *next, unsigned int numTasks) {
+    for (unsigned int i = (*next)++; i < numTasks; i = (*next)++)
+        (*task)(i);
+}
 
-public:
-    ParseRefFA() {
-        refSeq = NULL;
-        refSeqSize = 0;
+// 64 bit hash of len bytes, not cryptographic, for identifying file contents
+uint64_t hash64(const void *data, uint64_t len, uint64_t seed = 0) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t h = seed ^ (len * 0x9e3779b97f4a7c15ULL);
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h ^= word * 0xff51afd7ed558ccdULL;
+        h = ((h << 31) | (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
     }
+    uint64_t word = 0;
+    memcpy(&word, p, len);
+    h ^= word * 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
 
-    ~ParseRefFA() {
-        if (refSeq)
-            free(refSeq);
-    }
+// calls task(i) for each i in [0, numTasks) on up to numThreads threads, including this one
+template <class Task>
+void parallelFor(unsigned int numTasks, unsigned int numThreads, Task &task) {
+    if (numThreads > numTasks)
+        numThreads = numTasks;
+    std::atomic<unsigned int> next(0);
+    std::vector<std::thread> threads;
+    for (unsigned int i=1; i<numThreads; ++i)
+        threads.push_back(std::thread(parallelWorker<Task>, &task, &next, numTasks));
+    parallelWorker(&task, &next, numTasks);
+    for (unsigned int i=0; i<threads.size(); ++i)
+        threads[i].join();
+}
 
-    bool readFile(const char *filename) {
-        char buf[65536];
+// seconds from an arbitrary start, of the wall clock and of the CPU time of all threads
+double wallSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-        FILE *file = fopen(filename, "rb");
-        if (file == NULL)
-            return false;
+double cpuSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-        refSeqSize = 32*1024*1024;
-        refSeq = (uint8_t *)malloc(32*1024*1024);
-        uint64_t seqPos = 0;
+// largest resident set size of the process so far
+uint64_t peakRSSBytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return (uint64_t)usage.ru_maxrss * 1024;
+}
 
-        while (fgets(buf, 65536, file) != NULL) {
-            // read the line
-            if (buf[0] == '>') {
-                // marks the chromosome
-                for (int i=1; i<65536; ++i) {
-                    if (buf[i]==' ' || buf[i]=='\t') {
-                        buf[i]=0;
-                        break;
-                    }
-                }
-                std::string chrName;
-                if (buf[1]=='c' && buf[2]=='h' && buf[3]=='r')
-                    chrName = buf+4;
-                else
-                    chrName = buf+1;
-                chromStartPos[chrName] = seqPos;
-                chromStartPos["chr" + chrName] = seqPos;
-            }
-            else {
-                if (seqPos+65536 > refSeqSize) {
-                    refSeqSize += 32*1024*1024;
-                    uint8_t *newBuf = (uint8_t *)realloc(refSeq, refSeqSize);
-                    if (newBuf == NULL)
-                        return false;
-                    refSeq = newBuf;
-                }
-                for (int i=0; i<65536; ++i) {
-                    if (buf[i] == 0 || buf[i] == '\n' || buf[i] == '\r')
-                        break;
-                    if (buf[i] > 'Z') // convert lower case to upper case
-                        buf[i] = buf[i] - 'a' + 'A';
-                    refSeq[seqPos++] = buf[i];
-                }
-            }
-        }
-        return true;
-    }
-    
-    // get sequence string immediately preceding chromosome:pos of length len
-    std::string getPrefix(std::string &chromosome, uint64_t pos, uint64_t len) {
-        std::map<std::string, uint64_t>::iterator it = chromStartPos.find(chromosome);
-        if (it == chromStartPos.end())
-            return "";
-        uint64_t absPos = it->second + pos - 1;
-        if (len > absPos)
-            len = absPos;
-        std::string prefix((const char *)(&refSeq[absPos-len]), len);
-        return prefix;
+// writes s as a JSON string
+void writeJSONString(FILE *out, const std::string &s) {
+    fputc('"', out);
+    for (size_t i=0; i<s.size(); ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
     }
-};
+    fputc('"', out);
+}
 
-/* For example:
-##FORMAT=<ID=HQ,Number=2,Type=Integer,Description="Haplotype Quality">
-#CHROM POS     ID        REF ALT    QUAL FILTER INFO                              FORMAT      NA00001        NA00002        NA00003
-20     14370   rs6054257 G      A       29   PASS   NS=3;DP=14;AF=0.5;DB;H2           GT:GQ:DP:HQ 0|0:48:1:51,51 1|0:48:8:51,51 1/1:43:5:.,.
-20     17330   .         T      A       3    q10    NS=3;DP=11;AF=0.017               GT:GQ:DP:HQ 0|0:49:3:58,50 0|1:3:5:65,3   0/0:41:3
-20     1110696 rs6040355 A      G,T     67   PASS   NS=2;DP=10;AF=0.333,0.667;AA=T;DB GT:GQ:DP:HQ 1|2:21:6:23,27 2|1:2:0:18,2   2/2:35:4
-20     1230237 .         T      .       47   PASS   NS=3;DP=13;AA=T                   GT:GQ:DP:HQ 0|0:54:7:56,60 0|0:48:4:51,51 0/0:61:2
-20     1234567 microsat1 GTCT   G,GTACT 50   PASS   NS=3;DP=9;AA=G                    GT:GQ:DP    0/1:35:4       0/2:17:2       1/1:40:3
-*/
+// Wall clock and CPU seconds of the phases of a run, and of the parsing of each file, written as
+// a line of JSON with the peak RSS. CPU seconds are those of the whole process, so include every thread.
+class Profile {
+public:
+    struct FileStats {
+        std::string name;
+        bool cached;             // loaded from the variant cache rather than parsed
+        double parseSeconds;     // summed over the threads parsing the file
+        double normalizeSeconds; // the part of parseSeconds spent normalising variants
+        uint64_t variants;
+        uint64_t storeBytes;               // held by the parsed variants, see VariantStore::bytes
+        std::set<std::string> ignoredChrom; // contigs not in the dictionary
+    };
 
-struct Variant {
-    int chrom;
-    uint64_t pos;
-    unsigned int srcLen;
-    std::string dst;
-    double qual;
-    bool isTruePositive;
+protected:
+    struct Phase {
+        std::string name;
+        double wall;
+        double cpu;
+    };
+    std::vector<Phase> phases;
+    std::vector<FileStats> files;
+    std::vector<std::pair<std::string, std::string> > fields; // other members, values as JSON
+    std::string phaseName;
+    double phaseWall, phaseCpu;
 
-    Variant() {
-        chrom = 0;
-        pos = 0;
-        srcLen = 0;
-        dst.clear();
-        qual = 0.0;
-        isTruePositive = false;
+public:
+    // starts timing phase name, ending the previous phase if not ended
+    void begin(const char *name) {
+        if (!phaseName.empty())
+            end();
+        phaseName = name;
+        phaseWall = wallSeconds();
+        phaseCpu = cpuSeconds();
     }
 
-    unsigned int commonHead(const std::string &ref) {
-        unsigned int minLen = dst.size();
-        if (minLen > ref.size())
-            minLen = ref.size();
-        for (unsigned int i=0; i<minLen; ++i) {
-            if (ref[i] != dst[i])
-                return i;
-        }
-        return minLen;
+    void end() {
+        Phase phase;
+        phase.name = phaseName;
+        phase.wall = wallSeconds() - phaseWall;
+        phase.cpu = cpuSeconds() - phaseCpu;
+        phases.push_back(phase);
+        phaseName.clear();
     }
 
-    unsigned int commonTail(const std::string &ref) {
-        unsigned int minLen = dst.size();
-        if (minLen > ref.size())
-            minLen = ref.size();
-        for (unsigned int i=0; i<minLen; ++i) {
-            if (ref[ref.size()-i-1] != dst[dst.size()-i-1])
-                return i;
-        }
-        return minLen;
+    void addFile(const FileStats &stats) {
+        files.push_back(stats);
     }
 
-    std::string canonicalizeR(const std::string &ref) {
-        unsigned int commonTailLen = commonTail(ref);
-        if (commonTailLen==0)
-            return ref;
-        dst.resize(dst.size()-commonTailLen);
-        srcLen -= commonTailLen;
-        return ref.substr(0, ref.size()-commonTailLen);
+    void add(const char *name, double value) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.6g", value);
+        fields.push_back(std::make_pair(std::string(name), std::string(buffer)));
     }
 
-    void canonicalizeL(const std::string &ref) {
-        // remove any commonality at head and tail
-        unsigned int commonHeadLen = commonHead(ref);
-        if (commonHeadLen==0)
-            return;
-        dst = dst.substr(commonHeadLen);
-        pos += commonHeadLen;
-        srcLen -= commonHeadLen;
-    }
-    
-    bool hasCommonSuffix(const std::string &ref) {
-        return (ref[ref.size()-1] == dst[dst.size()-1]);
-    }
-    
-    /* Converts variant into a canonical form. Here are some examples:
-     1 100727133 . CCTCT CCT,C 152 => (+3,CT,{}),(+1,CTCT,{})
-     1 10087983 . CCTGA TCTGA,C 43 => (0,C,T),(+1,CTGA,{})
-     1 100926991 . CT TT,C 1066 => (0,C,T),(+1,T,{})
-     1 100976646 . T TGTTCA,TGTTCG 124 => (+1,{},GTTCA),(+1,{},GTTCG}
-    */
-    void canonicalize(const std::string &ref) {
-        canonicalizeR(ref);
-        canonicalizeL(ref);
-    }
-    
-    void prepend(const std::string &prefix) {
-        unsigned int len = prefix.size();
-        dst = prefix + dst;
-        pos -= len;
-        srcLen += len;
-    }
-
-    inline bool operator < (const Variant &X) const {
-        if (pos != X.pos)
-            return pos < X.pos;
-        if (chrom != X.chrom)
-            return chrom < X.chrom;
-        if (srcLen != X.srcLen)
-            return srcLen < X.srcLen;
-        return dst < X.dst;
+    void add(const char *name, uint64_t value) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%" PRIu64, value);
+        fields.push_back(std::make_pair(std::string(name), std::string(buffer)));
     }
-    
-    inline bool operator == (const Variant &X) const {
-        if (pos != X.pos)
-            return false;
-        if (chrom != X.chrom)
-            return false;
-        if (srcLen != X.srcLen)
-            return false;
-        return dst == X.dst;
+
+    // {fields..., "peak_rss_bytes", "phases": [{"name", "wall", "cpu"}...], "files": [...], "ignored_contigs": [...]}
+    // on one line
+    void write(FILE *out) const {
+        fputc('{', out);
+        for (size_t i=0; i<fields.size(); ++i) {
+            writeJSONString(out, fields[i].first);
+            fprintf(out, ":%s,", fields[i].second.c_str());
+        }
+        fprintf(out, "\"peak_rss_bytes\":%" PRIu64 ",", peakRSSBytes());
+        fprintf(out, "\"phases\":[");
+        for (size_t i=0; i<phases.size(); ++i) {
+            fprintf(out, "%s{\"name\":", i ? "," : "");
+            writeJSONString(out, phases[i].name);
+            fprintf(out, ",\"wall\":%.6f,\"cpu\":%.6f}", phases[i].wall, phases[i].cpu);
+        }
+        fprintf(out, "],\"files\":[");
+        std::set<std::string> ignored;
+        for (size_t i=0; i<files.size(); ++i) {
+            fprintf(out, "%s{\"name\":", i ? "," : "");
+            writeJSONString(out, files[i].name);
+            fprintf(out, ",\"cached\":%s,\"parse_thread_seconds\":%.6f,\"normalize_thread_seconds\":%.6f,\"variants\":%" PRIu64 ",\"store_bytes\":%" PRIu64 ",\"ignored_contigs\":%u}",
+                    files[i].cached ? "true" : "false", files[i].parseSeconds, files[i].normalizeSeconds, files[i].variants, files[i].storeBytes,
+                    (unsigned int)files[i].ignoredChrom.size());
+            ignored.insert(files[i].ignoredChrom.begin(), files[i].ignoredChrom.end());
+        }
+        fprintf(out, "],\"ignored_contigs\":[");
+        for (std::set<std::string>::const_iterator it = ignored.begin(); it != ignored.end(); ++it) {
+            if (it != ignored.begin())
+                fputc(',', out);
+            writeJSONString(out, *it);
+        }
+        fprintf(out, "]}\n");
     }
 };
 
-struct ROCItem {
-    unsigned int truePositives;
-    unsigned int falsePositives;
+#define REF_WINDOW_SIZE 4096 // bases per decoded reference window
+#define REF_WINDOW_CACHE 16  // number of decoded windows kept
 
-    ROCItem() {
-        truePositives = 0;
-        falsePositives = 0;
-    }
+// Contig of a .fai index (as written by samtools faidx)
+struct FaiEntry {
+    std::string name;
+    uint64_t length;    // number of bases
+    uint64_t offset;    // file offset of the first base
+    uint64_t lineBases; // bases per line
+    uint64_t lineWidth; // bytes per line including the line terminator
+};
 
-    void addTruePositive() {
-        truePositives++;
-    }
-    
-    void addFalsePositive() {
-        falsePositives++;
-    }
+// Binary reference image written by "genotypeMetrics packref", in host byte order:
+// header, contig table, contig names, then per contig the bases packed 2 bits each (A,C,G,T as
+// 0..3, first base in the low bits) followed by the runs of any other character (N, IUPAC codes)
+#define REF_IMAGE_MAGIC "GMREF2B"
+#define REF_IMAGE_VERSION 1
 
-    void add(const ROCItem &X) {
-        truePositives += X.truePositives;
-        falsePositives += X.falsePositives;
-    }
+struct RefImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numContigs;
 };
 
-// Chromosome, position, ID, Ref, [Alt,...], Quality, Filter
-class VCFParser {
+struct RefImageContig {
+    uint64_t nameOffset;
+    uint64_t nameLen;
+    uint64_t length;
+    uint64_t basesOffset;
+    uint64_t exceptionsOffset;
+    uint64_t numExceptions;
+};
+
+struct RefImageException {
+    uint64_t start;
+    uint32_t len;
+    uint32_t base;
+};
+
+// Parse reference FA file. The FASTA is mmap'd and accessed at random through its .fai index,
+// which is built (and written next to the FASTA if possible) when missing. Decoded upper case
+// windows of the sequence are kept in a small LRU cache per thread. A reference image is mmap'd
+// and decoded directly instead.
+class ParseRefFA {
 protected:
-    std::map<std::string, int> chromMap;
-    std::set<std::string> ignoredChrom;
-    uint64_t countTruePositives;
+    struct RefWindow {
+        uint64_t owner;   // instance of the ParseRefFA decoded, 0 for an unused window
+        int contig;
+        uint64_t start;   // first base of the window in the contig
+        uint64_t len;
+        uint64_t lastUse;
+        char bases[REF_WINDOW_SIZE];
+    };
 
-    // true if no error, false if error
-    bool parseLine(const int compareType, char *cline, ParseRefFA *parseRefFA = NULL, VCFParser *positiveSet = NULL, std::set<Variant> *positiveVariants = NULL) {
-        if (cline[0] == 0)
-            return true;
-        if (cline[0] == '#')
-            return true;
+    // windows of the calling thread, so that parse threads and serve requests do not contend
+    struct WindowCache {
+        RefWindow windows[REF_WINDOW_CACHE];
+        uint64_t useCount;
 
-        // tokenize
-        char *saveptr, *token1, *token2, /* *token3,*/ *token4, *token5, *token6, *altToken;
-        token1 = strtok_r(cline, " \t", &saveptr);
-        token2 = strtok_r(NULL, " \t", &saveptr);
-        strtok_r(NULL, " \t", &saveptr);
-        token4 = strtok_r(NULL, " \t", &saveptr);
-        token5 = strtok_r(NULL, " \t", &saveptr);
-        token6 = strtok_r(NULL, " \t", &saveptr);
-        if (token6 != NULL) {
-            std::string chrom = token1;
-            std::map<std::string, int>::iterator iter = chromMap.find(chrom);
-            std::string refStr = token4;
-            if (iter == chromMap.end()) {
-                if (ignoredChrom.insert(chrom).second) {
-                    //printf("Warning - unable to find chromosome [%s]\n", chrom.c_str());
-                }
-                return true;
+        WindowCache() : useCount(0) {
+            for (int i=0; i<REF_WINDOW_CACHE; ++i) {
+                windows[i].owner = 0;
+                windows[i].lastUse = 0;
             }
-            else {
-                Variant v, v2;
-                v.chrom = iter->second;
-                v.pos = atol(token2);
-                v.srcLen = refStr.size();
-                v.qual = atof(token6);
-                altToken = strtok_r(token5, ",", &saveptr);
-                while (altToken != NULL) {
-                    v2 = v;
-                    v2.dst = altToken;
-                    std::string refStr2 = refStr;
-                    if (parseRefFA != NULL) {
-                        // use reference sequence to normalise to a canonical form with minimum possible 'pos'
-                        while (v2.hasCommonSuffix(refStr2)) {
-                            std::string prefix = parseRefFA->getPrefix(chrom, v2.pos, 100);
-                            // prepend both the variant and reference with the real prefix sequence data
-                            v2.prepend(prefix);
-                            refStr2 = v2.canonicalizeR(prefix + refStr2); // discard RHS common portion
-                        }
-                    }
-                    // final RHS and LHS canonicalization
-                    v2.canonicalize(refStr2);
-                    if (positiveSet != NULL) {
-                        v2.isTruePositive = (positiveSet->variantDB.find(v2) != positiveSet->variantDB.end());
+        }
+    };
+
+    static WindowCache &threadWindows() {
+        static thread_local WindowCache cache;
+        return cache;
+    }
+
+    int fd;
+    const uint8_t *refMap;
+    uint64_t refMapSize;
+    std::vector<FaiEntry> contigs;
+    std::map<std::string, unsigned int> chromContig; // chromosome name with and without "chr" -> contigs index
+    uint64_t instance; // distinguishes the windows of this reference in the thread caches
+    const RefImageContig *imageContigs; // NULL unless reading a reference image
+
+    bool readImage() {
+        const RefImageHeader *header = (const RefImageHeader *)refMap;
+        uint64_t tableEnd = sizeof(RefImageHeader) + (uint64_t)header->numContigs * sizeof(RefImageContig);
+        if (header->version != REF_IMAGE_VERSION || tableEnd > refMapSize) {
+            errno = EINVAL;
+            return false;
+        }
+        imageContigs = (const RefImageContig *)(refMap + sizeof(RefImageHeader));
+        for (unsigned int i=0; i<header->numContigs; ++i) {
+            const RefImageContig &contig = imageContigs[i];
+            if (contig.nameOffset + contig.nameLen > refMapSize
+                || contig.basesOffset + (contig.length+3)/4 > refMapSize
+                || contig.exceptionsOffset + contig.numExceptions * sizeof(RefImageException) > refMapSize) {
+                errno = EINVAL;
+                return false;
+            }
+            FaiEntry entry;
+            entry.name.assign((const char *)refMap + contig.nameOffset, contig.nameLen);
+            entry.length = contig.length;
+            entry.offset = contig.basesOffset;
+            entry.lineBases = 0;
+            entry.lineWidth = 0;
+            contigs.push_back(entry);
+        }
+        return true;
+    }
+
+    // decode bases [start, start+len) of an image contig, which must lie within the contig
+    void decodeImage(unsigned int contig, uint64_t start, uint64_t len, char *out) const {
+        static const char bases[4] = { 'A', 'C', 'G', 'T' };
+        const RefImageContig &entry = imageContigs[contig];
+        const uint8_t *packed = refMap + entry.basesOffset;
+        for (uint64_t i=0; i<len; ++i) {
+            uint64_t base = start+i;
+            out[i] = bases[(packed[base >> 2] >> ((base & 3) << 1)) & 3];
+        }
+        // overwrite with the runs of other characters that overlap the range
+        const RefImageException *exceptions = (const RefImageException *)(refMap + entry.exceptionsOffset);
+        uint64_t lo = 0, hi = entry.numExceptions;
+        while (lo < hi) { // first run ending after start
+            uint64_t mid = (lo + hi) / 2;
+            if (exceptions[mid].start + exceptions[mid].len <= start)
+                lo = mid+1;
+            else
+                hi = mid;
+        }
+        for (uint64_t i=lo; i<entry.numExceptions && exceptions[i].start < start+len; ++i) {
+            uint64_t from = (exceptions[i].start > start) ? exceptions[i].start : start;
+            uint64_t to = exceptions[i].start + exceptions[i].len;
+            if (to > start+len)
+                to = start+len;
+            memset(out + (from-start), exceptions[i].base, to-from);
+        }
+    }
+
+    // read the .fai index at filename, false if it does not exist or is malformed
+    bool readIndex(const std::string &filename) {
+        FILE *file = fopen(filename.c_str(), "r");
+        if (file == NULL)
+            return false;
+        char buf[65536];
+        while (fgets(buf, sizeof(buf), file) != NULL) {
+            char *saveptr;
+            char *name = strtok_r(buf, "\t\n", &saveptr);
+            char *length = strtok_r(NULL, "\t\n", &saveptr);
+            char *offset = strtok_r(NULL, "\t\n", &saveptr);
+            char *lineBases = strtok_r(NULL, "\t\n", &saveptr);
+            char *lineWidth = strtok_r(NULL, "\t\n", &saveptr);
+            if (lineWidth == NULL) {
+                fclose(file);
+                contigs.clear();
+                return false;
+            }
+            FaiEntry entry;
+            entry.name = name;
+            entry.length = strtoull(length, NULL, 10);
+            entry.offset = strtoull(offset, NULL, 10);
+            entry.lineBases = strtoull(lineBases, NULL, 10);
+            entry.lineWidth = strtoull(lineWidth, NULL, 10);
+            contigs.push_back(entry);
+        }
+        fclose(file);
+        return true;
+    }
+
+    // build the index from one pass over the mapped FASTA, false if the line lengths of a contig differ
+    bool buildIndex() {
+        uint64_t p = 0;
+        FaiEntry *entry = NULL;
+        bool lastLine = false; // a short line was seen, it must be the last of the contig
+        while (p < refMapSize) {
+            const uint8_t *eol = (const uint8_t *)memchr(refMap+p, '\n', refMapSize-p);
+            uint64_t lineEnd = (eol == NULL) ? refMapSize : (eol - refMap) + 1;
+            if (refMap[p] == '>') {
+                uint64_t nameEnd = p+1;
+                while (nameEnd < lineEnd && !isspace(refMap[nameEnd]))
+                    nameEnd++;
+                FaiEntry newEntry;
+                newEntry.name.assign((const char *)refMap+p+1, nameEnd-p-1);
+                newEntry.length = 0;
+                newEntry.offset = lineEnd;
+                newEntry.lineBases = 0;
+                newEntry.lineWidth = 0;
+                contigs.push_back(newEntry);
+                entry = &contigs.back();
+                lastLine = false;
+            }
+            else if (entry != NULL) {
+                uint64_t bases = lineEnd - p;
+                while (bases > 0 && (refMap[p+bases-1] == '\n' || refMap[p+bases-1] == '\r'))
+                    bases--;
+                if (bases > 0) {
+                    if (entry->lineBases == 0) {
+                        entry->lineBases = bases;
+                        entry->lineWidth = lineEnd - p;
                     }
-                    altToken = strtok_r(NULL, ",", &saveptr);
-                    bool isSNP = (v2.srcLen == 1 && v2.dst.size() == 1);
-                    if (compareType == COMPARE_SNP && !isSNP)
-                        continue;
-                    if (compareType == COMPARE_INDEL && isSNP)
-                        continue;
-                    bool isNewVariant = variantDB.insert(v2).second;
-                    if (v2.isTruePositive && isNewVariant) {
-                        countTruePositives++;
-                        if (positiveVariants != NULL)
-                            positiveVariants->insert(v2);
+                    else if (lastLine || bases > entry->lineBases || (bases == entry->lineBases && lineEnd - p != entry->lineWidth)) {
+                        fprintf(stderr, "Different line lengths in reference contig %s\n", entry->name.c_str());
+                        errno = EINVAL;
+                        return false;
                     }
+                    if (bases < entry->lineBases)
+                        lastLine = true;
+                    entry->length += bases;
                 }
             }
+            p = lineEnd;
         }
         return true;
     }
 
-    static bool _sortFn(const Variant &X, const Variant &Y) {
-        if (X.qual != Y.qual)
-            return X.qual > Y.qual;
-        return X.pos < Y.pos;
+    bool writeIndex(const std::string &filename) const {
+        FILE *file = fopen(filename.c_str(), "w");
+        if (file == NULL)
+            return false;
+        for (std::vector<FaiEntry>::const_iterator it = contigs.begin(); it != contigs.end(); ++it) {
+            fprintf(file, "%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n", it->name.c_str(), it->length, it->offset, it->lineBases, it->lineWidth);
+        }
+        return fclose(file) == 0;
     }
-    
-public:
-    // need to convert chromosome and position to an actual full position
-    std::set<Variant> variantDB;
-
-    VCFParser() {
-        // ensure consistent mapping of chromosome names
-        chromMap["X"] = -1;
-        chromMap["chrX"] = -1;
-        chromMap["Y"] = -2;
-        chromMap["chrY"] = -2;
-        chromMap["M"] = -3;
-        chromMap["chrM"] = -3;
-        chromMap["MT"] = -3;
-        chromMap["chrMT"] = -3;
-        for (unsigned int i=1; i<1000; ++i) {
-            char namebuf[256];
-            snprintf(namebuf, 256, "%u", i);
-            std::string name = namebuf;
-            chromMap[name] = i;
-            chromMap["chr"+name] = i;
+
+    // decoded upper case window holding base pos (0-based) of contig, in cache
+    const RefWindow *getWindow(WindowCache &cache, unsigned int contig, uint64_t pos) const {
+        uint64_t start = pos - pos % REF_WINDOW_SIZE;
+        RefWindow *windows = cache.windows;
+        RefWindow *oldest = &windows[0];
+        for (int i=0; i<REF_WINDOW_CACHE; ++i) {
+            if (windows[i].owner == instance && windows[i].contig == (int)contig && windows[i].start == start) {
+                windows[i].lastUse = ++cache.useCount;
+                return &windows[i];
+            }
+            if (windows[i].lastUse < oldest->lastUse)
+                oldest = &windows[i];
         }
-        countTruePositives = 0;
+        const FaiEntry &entry = contigs[contig];
+        uint64_t len = entry.length - start;
+        if (len > REF_WINDOW_SIZE)
+            len = REF_WINDOW_SIZE;
+        for (uint64_t i=0; i<len; ) {
+            uint64_t base = start+i;
+            uint64_t lineOffset = base % entry.lineBases;
+            uint64_t offset = entry.offset + (base / entry.lineBases) * entry.lineWidth + lineOffset;
+            uint64_t n = entry.lineBases - lineOffset;
+            if (n > len-i)
+                n = len-i;
+            if (offset + n > refMapSize) // truncated file
+                n = (offset < refMapSize) ? refMapSize - offset : 0;
+            if (n == 0) {
+                len = i;
+                break;
+            }
+            for (uint64_t j=0; j<n; ++j) {
+                char c = refMap[offset+j];
+                if (c > 'Z') // convert lower case to upper case
+                    c = c - 'a' + 'A';
+                oldest->bases[i+j] = c;
+            }
+            i += n;
+        }
+        oldest->owner = instance;
+        oldest->contig = contig;
+        oldest->start = start;
+        oldest->len = len;
+        oldest->lastUse = ++cache.useCount;
+        return oldest;
     }
-    
-    size_t size() const {
-        return variantDB.size();
+
+public:
+    ParseRefFA() {
+        fd = -1;
+        refMap = NULL;
+        refMapSize = 0;
+        imageContigs = NULL;
+        static std::atomic<uint64_t> nextInstance(1);
+        instance = nextInstance++;
     }
-    
-    uint64_t numTruePositives() const {
-        return countTruePositives;
+
+    ~ParseRefFA() {
+        if (refMap)
+            munmap((void *)refMap, refMapSize);
+        if (fd >= 0)
+            close(fd);
     }
-    
-    bool parseFile(const int compareType, const std::string &filename, ParseRefFA *parseRefFA = NULL, VCFParser *positiveSet = NULL, std::set<Variant> *positiveVariants = NULL) {
-        FILE *in = fopen(filename.c_str(), "r");
-        if (in == NULL) {
-            printf("Unable to open input file: %s [%s]\n", filename.c_str(), strerror(errno));
+
+    bool readFile(const char *filename) {
+        fd = open(filename, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
             return false;
+        refMapSize = st.st_size;
+        if (refMapSize > 0) {
+            void *p = mmap(NULL, refMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+                return false;
+            refMap = (const uint8_t *)p;
+            madvise(p, refMapSize, MADV_RANDOM);
         }
-        char line[4*1024*1024];
-        while (fgets(line, sizeof(line), in)) {
-            if (!parseLine(compareType, line, parseRefFA, positiveSet, positiveVariants)) {
-                fclose(in);
+
+        std::string indexName = std::string(filename) + ".fai";
+        if (refMapSize >= sizeof(RefImageHeader) && memcmp(refMap, REF_IMAGE_MAGIC, sizeof(REF_IMAGE_MAGIC)) == 0) {
+            if (!readImage())
+                return false;
+        }
+        else if (!readIndex(indexName)) {
+            if (!buildIndex())
+                return false;
+            writeIndex(indexName); // not fatal, e.g. for a read only directory
+        }
+
+        for (unsigned int i=0; i<contigs.size(); ++i) {
+            const std::string &name = contigs[i].name;
+            if (imageContigs == NULL && contigs[i].lineBases == 0 && contigs[i].length > 0) {
+                errno = EINVAL;
                 return false;
             }
+            std::string chrName = (name.compare(0, 3, "chr") == 0) ? name.substr(3) : name;
+            chromContig[chrName] = i;
+            chromContig["chr" + chrName] = i;
         }
-        fclose(in);
         return true;
     }
 
-    // returns sorted variants from largest quality to smallest quality
-    void getQualSortedVariants(std::map<double, ROCItem> *sorted) const {
-        if (sorted == NULL)
-            return;
-        sorted->clear();
-        for (std::set<Variant>::iterator it = variantDB.begin(); it != variantDB.end(); ++it) {
-            if (it->isTruePositive)
-                (*sorted)[it->qual].addTruePositive();
-            else
-                (*sorted)[it->qual].addFalsePositive();
+    // copy bases [start, start+len) of contig in upper case to out, returns the number copied
+    uint64_t getBases(unsigned int contig, uint64_t start, uint64_t len, char *out) {
+        uint64_t length = contigs[contig].length;
+        if (start >= length)
+            return 0;
+        if (len > length - start)
+            len = length - start;
+        if (imageContigs != NULL) {
+            decodeImage(contig, start, len, out);
+            return len;
         }
-
-        std::map<double, std::set<Variant> > holepos, holeneg;
-        for (std::set<Variant>::iterator it = variantDB.begin(); it != variantDB.end(); ++it) {
-            if (it->isTruePositive)
-                holepos[it->qual].insert(*it);
-            else
-                holeneg[it->qual].insert(*it);
+        WindowCache &cache = threadWindows();
+        uint64_t copied = 0;
+        while (copied < len) {
+            const RefWindow *window = getWindow(cache, contig, start+copied);
+            uint64_t offset = start + copied - window->start;
+            if (offset >= window->len)
+                break;
+            uint64_t n = window->len - offset;
+            if (n > len - copied)
+                n = len - copied;
+            memcpy(out + copied, window->bases + offset, n);
+            copied += n;
         }
+        return copied;
+    }
 
-/*
-        for (std::set<Variant>::iterator iter = holeneg.rbegin()->second.begin(); iter != holeneg.rbegin()->second.end(); ++iter) {
-            printf("NEG: qual %lf chrom %d pos %"PRId64" srcLen %d dst %s\n", iter->qual, iter->chrom, iter->pos, iter->srcLen, iter->dst.c_str());
+    // identifies the reference file by its size and modification time and its contig table, as
+    // read from the .fai or the image header, without reading the bases so that only the windows
+    // used are ever loaded. A reference masked or patched in place gets a new modification time.
+    uint64_t identity() const {
+        uint64_t h = contigs.size();
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            int64_t stamp[3] = { (int64_t)st.st_size, (int64_t)st.st_mtim.tv_sec, (int64_t)st.st_mtim.tv_nsec };
+            h = hash64(stamp, sizeof(stamp), h);
         }
-        for (std::set<Variant>::iterator iter = holepos.rbegin()->second.begin(); iter != holepos.rbegin()->second.end(); ++iter) {
-            printf("POS: qual %lf chrom %d pos %"PRId64" srcLen %d dst %s\n", iter->qual, iter->chrom, iter->pos, iter->srcLen, iter->dst.c_str());
+        for (unsigned int i=0; i<contigs.size(); ++i) {
+            uint64_t layout[4] = { contigs[i].length, contigs[i].offset, contigs[i].lineBases, contigs[i].lineWidth };
+            h = hash64(contigs[i].name.data(), contigs[i].name.size(), h);
+            h = hash64(layout, sizeof(layout), h);
         }
-*/
+        return h;
     }
-};
 
-int main(int argc, char *argv[]) {
-    ParseRefFA *refFile = NULL;
-    if (argc < 5) {
-        goto failed;
+    // index of a chromosome, given with or without "chr", -1 if not in the reference
+    int findContig(const std::string &chromosome) const {
+        std::map<std::string, unsigned int>::const_iterator it = chromContig.find(chromosome);
+        return (it == chromContig.end()) ? -1 : (int)it->second;
     }
-    int compareType;
-    if (strcmp(argv[1], "snp") == 0) {
-        compareType = COMPARE_SNP;
+
+    uint64_t contigLength(unsigned int contig) const {
+        return contigs[contig].length;
     }
-    else if (strcmp(argv[1], "indel") == 0) {
-        compareType = COMPARE_INDEL;
+
+    unsigned int numContigs() const {
+        return contigs.size();
     }
-    else if (strcmp(argv[1], "all") == 0) {
-        compareType = COMPARE_ALL;
+
+    const std::string &contigName(unsigned int contig) const {
+        return contigs[contig].name;
     }
-    else {
-        goto failed;
+
+    // write a reference image of the reference read so far, see RefImageHeader
+    bool writeImage(const char *filename) {
+        FILE *out = fopen(filename, "wb");
+        if (out == NULL)
+            return false;
+        RefImageHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, REF_IMAGE_MAGIC, sizeof(REF_IMAGE_MAGIC));
+        header.version = REF_IMAGE_VERSION;
+        header.numContigs = contigs.size();
+        std::vector<RefImageContig> table(contigs.size());
+        uint64_t offset = sizeof(RefImageHeader) + contigs.size() * sizeof(RefImageContig);
+        for (unsigned int i=0; i<contigs.size(); ++i) {
+            table[i].nameOffset = offset;
+            table[i].nameLen = contigs[i].name.size();
+            table[i].length = contigs[i].length;
+            offset += contigs[i].name.size();
+        }
+        // table and names are written last, once the offsets of the sequence data are known
+        if (fseek(out, offset, SEEK_SET) != 0) {
+            fclose(out);
+            return false;
+        }
+        std::vector<char> bases(REF_WINDOW_SIZE);
+        std::vector<uint8_t> packed(REF_WINDOW_SIZE/4);
+        std::vector<RefImageException> exceptions;
+        for (unsigned int i=0; i<contigs.size(); ++i) {
+            table[i].basesOffset = offset;
+            exceptions.clear();
+            for (uint64_t start=0; start<contigs[i].length; start+=REF_WINDOW_SIZE) {
+                uint64_t len = getBases(i, start, REF_WINDOW_SIZE, &bases[0]);
+                if (len == 0) {
+                    fclose(out);
+                    errno = EINVAL;
+                    return false;
+                }
+                memset(&packed[0], 0, packed.size());
+                for (uint64_t j=0; j<len; ++j) {
+                    uint8_t code;
+                    switch (bases[j]) {
+                    case 'A': code = 0; break;
+                    case 'C': code = 1; break;
+                    case 'G': code = 2; break;
+                    case 'T': code = 3; break;
+                    default:
+                        code = 0;
+                        if (!exceptions.empty() && exceptions.back().base == (uint8_t)bases[j]
+                            && exceptions.back().start + exceptions.back().len == start+j && exceptions.back().len < UINT32_MAX) {
+                            exceptions.back().len++;
+                        }
+                        else {
+                            RefImageException exception;
+                            exception.start = start+j;
+                            exception.len = 1;
+                            exception.base = (uint8_t)bases[j];
+                            exceptions.push_back(exception);
+                        }
+                    }
+                    packed[j >> 2] |= code << ((j & 3) << 1);
+                }
+                fwrite(&packed[0], 1, (len+3)/4, out);
+                offset += (len+3)/4;
+            }
+            for (; offset % 8 != 0; ++offset) // align the runs
+                fputc(0, out);
+            table[i].exceptionsOffset = offset;
+            table[i].numExceptions = exceptions.size();
+            if (!exceptions.empty())
+                fwrite(&exceptions[0], sizeof(RefImageException), exceptions.size(), out);
+            offset += exceptions.size() * sizeof(RefImageException);
+        }
+        if (fseek(out, 0, SEEK_SET) != 0) {
+            fclose(out);
+            return false;
+        }
+        fwrite(&header, sizeof(header), 1, out);
+        if (!table.empty())
+            fwrite(&table[0], sizeof(RefImageContig), table.size(), out);
+        for (unsigned int i=0; i<contigs.size(); ++i)
+            fwrite(contigs[i].name.data(), 1, contigs[i].name.size(), out);
+        bool ok = !ferror(out);
+        return (fclose(out) == 0) && ok;
     }
+};
 
-    // read fa file
-    if (strcmp(argv[2], "none") != 0) {
-        refFile = new ParseRefFA();
-        if (!refFile->readFile(argv[2])) {
-            printf("Error reading file %s: %s\n", argv[2], strerror(errno));
-            goto errfailed;
+/* For example:
+##FORMAT=<ID=HQ,Number=2,Type=Integer,Description="Haplotype Quality">
+#CHROM POS     ID        REF ALT    QUAL FILTER INFO                              FORMAT      NA00001        NA00002        NA00003
+20     14370   rs6054257 G      A       29   PASS   NS=3;DP=14;AF=0.5;DB;H2           GT:GQ:DP:HQ 0|0:48:1:51,51 1|0:48:8:51,51 1/1:43:5:.,.
+20     17330   .         T      A       3    q10    NS=3;DP=11;AF=0.017               GT:GQ:DP:HQ 0|0:49:3:58,50 0|1:3:5:65,3   0/0:41:3
+20     1110696 rs6040355 A      G,T     67   PASS   NS=2;DP=10;AF=0.333,0.667;AA=T;DB GT:GQ:DP:HQ 1|2:21:6:23,27 2|1:2:0:18,2   2/2:35:4
+20     1230237 .         T      .       47   PASS   NS=3;DP=13;AA=T                   GT:GQ:DP:HQ 0|0:54:7:56,60 0|0:48:4:51,51 0/0:61:2
+20     1234567 microsat1 GTCT   G,GTACT 50   PASS   NS=3;DP=9;AA=G                    GT:GQ:DP    0/1:35:4       0/2:17:2       1/1:40:3
+*/
+
+// Dense ids of the contigs of an evaluation, shared by all parsers. Contigs are taken from the
+// reference and then the ##contig lines of the VCF headers, in order; with neither, the human
+// chromosomes 1-999, X, Y and MT are used. A name also resolves with or without a "chr" prefix,
+// and M and MT are the same contig, unless another contig has that exact name.
+class ContigDictionary {
+protected:
+    std::vector<std::string> names;
+    std::vector<int> refContigs;         // reference contig of each id, -1 if not in the reference
+    std::map<std::string, int> exactIds; // names as given
+    std::map<std::string, int> aliasIds; // other names of a contig
+    ParseRefFA *parseRefFA;
+
+    static void aliases(const std::string &name, std::vector<std::string> *out) {
+        std::string base = (name.compare(0, 3, "chr") == 0) ? name.substr(3) : name;
+        out->push_back(base);
+        out->push_back("chr" + base);
+        if (base == "M" || base == "MT") {
+            out->push_back("M");
+            out->push_back("chrM");
+            out->push_back("MT");
+            out->push_back("chrMT");
         }
     }
 
-    if (argc == 5) {
-        VCFParser goldSet, sampleSet;
-        if (!goldSet.parseFile(compareType, argv[3], refFile)) {
-            printf("Error - unable to parse file %s\n", argv[3]);
-            goto errfailed;
+public:
+    ContigDictionary() : parseRefFA(NULL) {}
+
+    // add a contig unless a contig of that name is known, returns its id
+    int add(const std::string &name) {
+        std::map<std::string, int>::const_iterator it = exactIds.find(name);
+        if (it != exactIds.end())
+            return it->second;
+        int id = names.size();
+        names.push_back(name);
+        exactIds[name] = id;
+        std::vector<std::string> other;
+        aliases(name, &other);
+        int refContig = (parseRefFA != NULL) ? parseRefFA->findContig(name) : -1;
+        for (size_t i=0; i<other.size(); ++i) {
+            if (exactIds.find(other[i]) == exactIds.end())
+                aliasIds.insert(std::make_pair(other[i], id));
+            if (refContig < 0 && parseRefFA != NULL)
+                refContig = parseRefFA->findContig(other[i]);
         }
-        if (!sampleSet.parseFile(compareType, argv[4], refFile, &goldSet)) {
-            printf("Error - unable to parse file %s\n", argv[4]);
-            goto errfailed;
+        refContigs.push_back(refContig);
+        return id;
+    }
+
+    // add the contigs of the reference, which variants of the contigs are normalised against
+    void addReference(ParseRefFA *reference) {
+        parseRefFA = reference;
+        for (unsigned int i=0; i<reference->numContigs(); ++i)
+            add(reference->contigName(i));
+    }
+
+    // add the contigs of the ##contig lines of a VCF header, false if the VCF cannot be read
+    bool addVCFHeader(const std::string &filename) {
+        gzFile in = gzopen(filename.c_str(), "rb");
+        if (in == NULL)
+            return false;
+        char line[65536];
+        while (gzgets(in, line, sizeof(line)) != NULL && strncmp(line, "##", 2) == 0) {
+            if (strncmp(line, "##contig=<", 10) != 0)
+                continue;
+            const char *id = strstr(line, "ID=");
+            if (id == NULL)
+                continue;
+            id += 3;
+            size_t len = strcspn(id, ",>\r\n");
+            if (len > 0)
+                add(std::string(id, len));
         }
+        gzclose(in);
+        return true;
+    }
 
-        uint64_t trueSetSize = goldSet.size();
-        uint64_t sampleSetSize = sampleSet.size();
+    // add 1-999, X, Y and MT
+    void addHuman() {
+        for (unsigned int i=1; i<1000; ++i) {
+            char namebuf[32];
+            snprintf(namebuf, sizeof(namebuf), "%u", i);
+            add(namebuf);
+        }
+        add("X");
+        add("Y");
+        add("MT");
+    }
 
-        // items in sample that are in the gold set
-        uint64_t numTruePositives = sampleSet.numTruePositives();
+    // id of a contig name or alias, -1 if unknown
+    int find(const std::string &name) const {
+        std::map<std::string, int>::const_iterator it = exactIds.find(name);
+        if (it != exactIds.end())
+            return it->second;
+        it = aliasIds.find(name);
+        return (it == aliasIds.end()) ? -1 : it->second;
+    }
 
-        // items in sample that are not in the gold set
-        uint64_t numFalsePositives = sampleSetSize - numTruePositives;
+    const std::string &name(int id) const {
+        return names[id];
+    }
 
-        // items in gold set that are not in the sample
-        uint64_t numFalseNegatives = trueSetSize - numTruePositives;
+    // index of the contig in the reference, -1 if none
+    int refContig(int id) const {
+        return refContigs[id];
+    }
 
-        printf("Precision = %lf, Recall = %lf, F-score = %lf\n", (double)numTruePositives / (double)sampleSetSize, (double)numTruePositives / (double)trueSetSize, (double)(2*numTruePositives)/(double)(2*numTruePositives+numFalsePositives+numFalseNegatives));
-        printf("numTruePositives = %lf, sampleSetSize = %lf, trueSetSize = %lf\n", (double)numTruePositives, (double)sampleSetSize, (double)trueSetSize);
-        return 0;
+    unsigned int size() const {
+        return names.size();
     }
-    if (argc > 5) {
-        VCFParser goldSet;
-        std::vector<VCFParser *> sampleSets;
 
-        if (!goldSet.parseFile(compareType, argv[3], refFile)) {
-            printf("Error - unable to parse file %s\n", argv[3]);
-            goto errfailed;
+    // the name of contig id followed by each of its aliases and the name of the contig that alias
+    // resolves to, tab separated. A VCF line names the contig or one of its aliases, so two
+    // dictionaries giving the same resolution of a contig place the same lines on it.
+    std::string resolution(int id) const {
+        std::string line = names[id];
+        std::vector<std::string> other;
+        aliases(names[id], &other);
+        for (size_t i=0; i<other.size(); ++i) {
+            int otherId = find(other[i]);
+            line += "\t" + other[i] + "\t" + ((otherId < 0) ? std::string() : names[otherId]);
         }
-        uint64_t trueSetSize = goldSet.size();
+        return line;
+    }
+};
 
-        unsigned int numSamples = argc-4;
-        std::set<Variant> positiveVariants; // union of all true positives found across samples
-        uint64_t sampleSetSize[numSamples];
-        uint64_t numTruePositives[numSamples];
-        uint64_t numFalsePositives[numSamples];
-        uint64_t numFalseNegatives[numSamples];
-        for (int i=0; i<numSamples; ++i) {
-            sampleSets.push_back(new VCFParser());
-            if (!sampleSets[i]->parseFile(compareType, argv[i+4], refFile, &goldSet, &positiveVariants)) {
-                printf("Error - unable to parse file %s\n", argv[i+4]);
-                goto errfailed;
-            }
+// Resolves the contig names of consecutive VCF lines, which mostly repeat the name of the line
+// before, so only a change of contig is looked up. One per thread.
+class ContigLookup {
+protected:
+    const ContigDictionary *contigs;
+    std::string lastName;
+    int lastId;
 
-            sampleSetSize[i] = sampleSets[i]->size();
-            // items in sample that are in the gold set
-            numTruePositives[i] = sampleSets[i]->numTruePositives();
-            // items in sample that are not in the gold set
-            numFalsePositives[i] = sampleSetSize[i] - numTruePositives[i];
-            // items in gold set that are not in the sample
-            numFalseNegatives[i] = trueSetSize - numTruePositives[i];
+public:
+    ContigLookup(const ContigDictionary *contigs) : contigs(contigs), lastId(-1) {}
 
+    // id of the name of len characters, -1 if unknown
+    int find(const char *name, size_t len) {
+        if (lastName.empty() || lastName.compare(0, std::string::npos, name, len) != 0) {
+            lastName.assign(name, len);
+            lastId = contigs->find(lastName);
         }
-/*
-        for (int i=0; i<numSamples; ++i)
-            printf("%s ", argv[i+4]);
-        printf("\n");
-*/
-        unsigned int numUnionPositiveVariants = positiveVariants.size();
-        std::set<unsigned int> allSortedPos;
-        std::map<unsigned int, unsigned int> sortedSamples[numSamples];
-        double AUC[numSamples];
-        
-        allSortedPos.insert(0); // initial datapoint has no false positives
-        for (int i=0; i<numSamples; ++i) {
-            AUC[i] = 0.0;
-            std::map<double, ROCItem> sorted;
-            sampleSets[i]->getQualSortedVariants(&sorted);
-            ROCItem cumm;
-            for (std::map<double, ROCItem>::reverse_iterator iter = sorted.rbegin(); iter != sorted.rend(); ++iter) {
-                cumm.add(iter->second);
-                allSortedPos.insert(cumm.falsePositives);
-                sortedSamples[i][cumm.falsePositives] = cumm.truePositives;
-            }
-            unsigned int prevTruePos = 0;
-            unsigned int prevFalsePos = 0;
-            for (std::map<unsigned int, unsigned int>::iterator it=sortedSamples[i].begin(); it != sortedSamples[i].end(); ++it) {
-                // trapezoidal AUC calculation
-                AUC[i] += ((double)(it->second + prevTruePos) * (double)(it->first - prevFalsePos)) / 2.0;
-                prevTruePos = it->second;
-                prevFalsePos = it->first;
-            }
-            sortedSamples[i][0] = 0;
-        }
-        unsigned int maxFalsePositives = *allSortedPos.rbegin();
-        // interpolate from last given data point to (1.0,1.0) i.e. 100% true positive found at 100% false positive rate
-        for (int i=0; i<numSamples; ++i) {
-            // trapezoidal AUC calculation
-            AUC[i] += ((double)(numUnionPositiveVariants + sortedSamples[i].rbegin()->second) * (double)(maxFalsePositives - sortedSamples[i].rbegin()->first)) / 2.0;
-            sortedSamples[i][maxFalsePositives] = numUnionPositiveVariants;
+        return lastId;
+    }
+};
+
+#define NORMALIZE_PREFIX_LEN 100 // reference bases prepended to shift a variant left
+
+// Converts variants into a canonical form. Here are some examples:
+//  1 100727133 . CCTCT CCT,C 152 => (+3,CT,{}),(+1,CTCT,{})
+//  1 10087983 . CCTGA TCTGA,C 43 => (0,C,T),(+1,CTGA,{})
+//  1 100926991 . CT TT,C 1066 => (0,C,T),(+1,T,{})
+//  1 100976646 . T TGTTCA,TGTTCG 124 => (+1,{},GTTCA),(+1,{},GTTCG}
+// When the last bases of REF and ALT agree, both are prepended with up to 100 bases of reference
+// so the variant can shift to the left. Then any common tail and common head are removed. REF and
+// ALT are views into the VCF line and the prepended bases are kept in scratch space of the
+// normaliser, so nothing is allocated per allele. One normaliser is used per thread.
+class VariantNormalizer {
+protected:
+    ParseRefFA *parseRefFA;
+    const ContigDictionary *contigs;
+    char prefix[NORMALIZE_PREFIX_LEN];
+    std::vector<char> alleleBuf; // alternate allele when it spans prefix and ALT
+
+public:
+    // canonical variant of the last call of normalize, dst is valid until the next call
+    uint64_t pos;
+    unsigned int srcLen;
+    const char *dst;
+    unsigned int dstLen;
+
+    VariantNormalizer(ParseRefFA *parseRefFA, const ContigDictionary *contigs) : parseRefFA(parseRefFA), contigs(contigs) {}
+
+    // ref and alt of at least one base each, of the contig with id chrom
+    void normalize(int chrom, uint64_t refPos, const char *ref, unsigned int refLen, const char *alt, unsigned int altLen) {
+        // prefix (of length g) is virtually prepended to both alleles
+        unsigned int g = 0;
+        if (parseRefFA != NULL && ref[refLen-1] == alt[altLen-1]) {
+            int refContig = contigs->refContig(chrom);
+            if (refContig >= 0 && refPos > 0) {
+                uint64_t end = refPos - 1;
+                if (end > parseRefFA->contigLength(refContig))
+                    end = parseRefFA->contigLength(refContig);
+                uint64_t len = (end < NORMALIZE_PREFIX_LEN) ? end : NORMALIZE_PREFIX_LEN;
+                g = parseRefFA->getBases(refContig, end - len, len, prefix);
+            }
+        }
+        uint64_t lenR = g + refLen, lenA = g + altLen;
+
+        // remove the common tail, first within the alleles and then into the prefix
+        uint64_t minLen = (lenR < lenA) ? lenR : lenA;
+        uint64_t k = 0;
+        while (k < minLen && k < refLen && k < altLen && ref[refLen-1-k] == alt[altLen-1-k])
+            k++;
+        if (k == refLen || k == altLen) {
+            // the shorter allele is used up, continue comparing prefix bases with the longer one
+            const char *longer = (refLen > altLen) ? ref : alt;
+            uint64_t longerLen = (refLen > altLen) ? lenR : lenA;
+            while (k < minLen) {
+                uint64_t i = longerLen-1-k, j = minLen-1-k; // j < g
+                char c = (i < g) ? prefix[i] : longer[i-g];
+                if (c != prefix[j])
+                    break;
+                k++;
+            }
+        }
+        lenR -= k;
+        lenA -= k;
+
+        // remove the common head, the prefix itself is common to both. Without a reference the
+        // head of ALT is compared with all of REF, not only what is left after removing the tail.
+        uint64_t h = 0;
+        minLen = (lenR < lenA) ? lenR : lenA;
+        if (parseRefFA == NULL)
+            minLen = (refLen < lenA) ? refLen : lenA;
+        if (minLen > g) {
+            h = g;
+            while (h < minLen && ref[h-g] == alt[h-g])
+                h++;
+        }
+        else {
+            h = minLen;
+        }
+
+        pos = refPos - g + h;
+        srcLen = lenR - h;
+        dstLen = lenA - h;
+        if (lenA <= g) {
+            dst = prefix + h;
+        }
+        else if (h >= g) {
+            dst = alt + (h - g);
+        }
+        else {
+            alleleBuf.resize(dstLen);
+            memcpy(&alleleBuf[0], prefix + h, g - h);
+            memcpy(&alleleBuf[g - h], alt, lenA - g);
+            dst = &alleleBuf[0];
+        }
+    }
+};
+
+#define INLINE_ALLELE_LEN 8
+
+// Variant held in a VariantStore. Alternate alleles of up to INLINE_ALLELE_LEN bases are kept in
+// dst itself, longer ones in the allele arena of the store at offset dst.
+struct VariantRecord {
+    uint64_t pos;
+    double qual;
+    uint64_t dst;
+    uint32_t srcLen;
+    uint32_t dstLen : 31;
+    uint32_t isTruePositive : 1;
+};
+
+// Variants of a VCF file as a vector of records per chromosome. Once all variants are added,
+// finish() sorts each vector by position, reference length and alternate allele and removes the
+// duplicates, keeping the first added.
+class VariantStore {
+protected:
+    std::map<int, std::vector<VariantRecord> > chromRecords;
+    std::string alleles;
+    uint64_t numRecords;
+
+    struct RecordLess {
+        const VariantStore *store;
+        RecordLess(const VariantStore *store) : store(store) {}
+        bool operator()(const VariantRecord &X, const VariantRecord &Y) const {
+            return compare(*store, X, *store, Y) < 0;
+        }
+    };
+
+    struct RecordEqual {
+        const VariantStore *store;
+        RecordEqual(const VariantStore *store) : store(store) {}
+        bool operator()(const VariantRecord &X, const VariantRecord &Y) const {
+            return compare(*store, X, *store, Y) == 0;
+        }
+    };
+
+public:
+    typedef std::map<int, std::vector<VariantRecord> >::const_iterator const_iterator;
+
+    VariantStore() {
+        numRecords = 0;
+    }
+
+    void add(int chrom, uint64_t pos, unsigned int srcLen, const char *dst, unsigned int dstLen, double qual) {
+        VariantRecord record;
+        record.pos = pos;
+        record.qual = qual;
+        record.dst = 0;
+        record.srcLen = srcLen;
+        record.dstLen = dstLen;
+        record.isTruePositive = 0;
+        if (dstLen <= INLINE_ALLELE_LEN) {
+            memcpy(&record.dst, dst, dstLen);
+        }
+        else {
+            record.dst = alleles.size();
+            alleles.append(dst, dstLen);
+        }
+        chromRecords[chrom].push_back(record);
+        numRecords++;
+    }
+
+    const char *allele(const VariantRecord &record) const {
+        if (record.dstLen <= INLINE_ALLELE_LEN)
+            return (const char *)&record.dst;
+        return alleles.data() + record.dst;
+    }
+
+    // mark record i of chromosome chrom as a true positive
+    void markTruePositive(int chrom, size_t i) {
+        chromRecords[chrom][i].isTruePositive = 1;
+    }
+
+    // orders records of the same chromosome, possibly from different stores
+    static int compare(const VariantStore &A, const VariantRecord &X, const VariantStore &B, const VariantRecord &Y) {
+        if (X.pos != Y.pos)
+            return (X.pos < Y.pos) ? -1 : 1;
+        if (X.srcLen != Y.srcLen)
+            return (X.srcLen < Y.srcLen) ? -1 : 1;
+        unsigned int len = (X.dstLen < Y.dstLen) ? X.dstLen : Y.dstLen;
+        int c = memcmp(A.allele(X), B.allele(Y), len);
+        if (c != 0)
+            return c;
+        if (X.dstLen != Y.dstLen)
+            return (X.dstLen < Y.dstLen) ? -1 : 1;
+        return 0;
+    }
+
+    // add the records of X after those added so far
+    void append(const VariantStore &X) {
+        uint64_t alleleBase = alleles.size();
+        alleles.append(X.alleles);
+        for (const_iterator it = X.begin(); it != X.end(); ++it) {
+            std::vector<VariantRecord> &records = chromRecords[it->first];
+            size_t first = records.size();
+            records.insert(records.end(), it->second.begin(), it->second.end());
+            for (size_t i=first; i<records.size(); ++i) {
+                if (records[i].dstLen > INLINE_ALLELE_LEN)
+                    records[i].dst += alleleBase;
+            }
+        }
+        numRecords += X.numRecords;
+    }
+
+    struct FinishTask {
+        VariantStore *store;
+        std::vector<std::vector<VariantRecord> *> chroms;
+        void operator()(unsigned int i) {
+            std::vector<VariantRecord> &records = *chroms[i];
+            std::stable_sort(records.begin(), records.end(), RecordLess(store));
+            records.erase(std::unique(records.begin(), records.end(), RecordEqual(store)), records.end());
+        }
+    };
+
+    // sort and deduplicate, the chromosomes in parallel
+    void finish(unsigned int numThreads = 1) {
+        FinishTask task;
+        task.store = this;
+        for (std::map<int, std::vector<VariantRecord> >::iterator it = chromRecords.begin(); it != chromRecords.end(); ++it)
+            task.chroms.push_back(&it->second);
+        parallelFor(task.chroms.size(), numThreads, task);
+        numRecords = 0;
+        for (std::map<int, std::vector<VariantRecord> >::iterator it = chromRecords.begin(); it != chromRecords.end(); ++it)
+            numRecords += it->second.size();
+    }
+
+    // unmark the true positives of an earlier match(), to match against another gold set
+    void clearMatches() {
+        for (std::map<int, std::vector<VariantRecord> >::iterator it = chromRecords.begin(); it != chromRecords.end(); ++it) {
+            std::vector<VariantRecord> &records = it->second;
+            for (size_t i=0; i<records.size(); ++i)
+                records[i].isTruePositive = 0;
+        }
+    }
+
+    // mark the records that are also in gold as true positives and returns their number. The
+    // index of each gold record matched, counting across chromosomes in order, is set in goldMatched.
+    uint64_t match(const VariantStore &gold, std::vector<bool> *goldMatched = NULL) {
+        uint64_t numMatched = 0;
+        uint64_t goldBase = 0;
+        std::map<int, std::vector<VariantRecord> >::iterator it = chromRecords.begin();
+        for (const_iterator goldIt = gold.begin(); goldIt != gold.end(); goldBase += goldIt->second.size(), ++goldIt) {
+            while (it != chromRecords.end() && it->first < goldIt->first)
+                ++it;
+            if (it == chromRecords.end())
+                break;
+            if (it->first != goldIt->first)
+                continue;
+            std::vector<VariantRecord> &records = it->second;
+            const std::vector<VariantRecord> &goldRecords = goldIt->second;
+            size_t i = 0, j = 0;
+            while (i < records.size() && j < goldRecords.size()) {
+                int c = compare(*this, records[i], gold, goldRecords[j]);
+                if (c < 0) {
+                    i++;
+                }
+                else if (c > 0) {
+                    j++;
+                }
+                else {
+                    records[i].isTruePositive = 1;
+                    numMatched++;
+                    if (goldMatched != NULL)
+                        (*goldMatched)[goldBase + j] = true;
+                    i++;
+                    j++;
+                }
+            }
+        }
+        return numMatched;
+    }
+
+    const_iterator begin() const {
+        return chromRecords.begin();
+    }
+
+    const_iterator end() const {
+        return chromRecords.end();
+    }
+
+    uint64_t size() const {
+        return numRecords;
+    }
+
+    // chromosomes with records
+    size_t numChroms() const {
+        return chromRecords.size();
+    }
+
+    // write the records and alleles, as read back by read()
+    bool write(FILE *out) const {
+        uint64_t header[2] = { chromRecords.size(), alleles.size() };
+        bool ok = fwrite(header, sizeof(header), 1, out) == 1;
+        for (const_iterator it = begin(); ok && it != end(); ++it) {
+            int64_t chrom[2] = { it->first, (int64_t)it->second.size() };
+            ok = fwrite(chrom, sizeof(chrom), 1, out) == 1;
+        }
+        for (const_iterator it = begin(); ok && it != end(); ++it) {
+            if (!it->second.empty())
+                ok = fwrite(&it->second[0], sizeof(VariantRecord), it->second.size(), out) == it->second.size();
+        }
+        return ok && fwrite(alleles.data(), 1, alleles.size(), out) == alleles.size();
+    }
+
+    // replace the contents with what write() wrote at data, false if it is truncated
+    bool read(const uint8_t *data, uint64_t size) {
+        uint64_t header[2];
+        if (size < sizeof(header))
+            return false;
+        memcpy(header, data, sizeof(header));
+        uint64_t offset = sizeof(header);
+        if (header[0] > (size - offset) / (2*sizeof(int64_t)))
+            return false;
+        std::vector<int64_t> chroms(2*header[0]);
+        if (!chroms.empty())
+            memcpy(&chroms[0], data + offset, chroms.size() * sizeof(int64_t));
+        offset += chroms.size() * sizeof(int64_t);
+        chromRecords.clear();
+        numRecords = 0;
+        for (uint64_t i=0; i<header[0]; ++i) {
+            uint64_t count = chroms[2*i+1];
+            if (count > (size - offset) / sizeof(VariantRecord))
+                return false;
+            std::vector<VariantRecord> &records = chromRecords[chroms[2*i]];
+            records.resize(count);
+            if (count > 0)
+                memcpy(&records[0], data + offset, count * sizeof(VariantRecord));
+            offset += count * sizeof(VariantRecord);
+            numRecords += count;
+        }
+        if (header[1] != size - offset)
+            return false;
+        alleles.assign((const char *)data + offset, header[1]);
+        return true;
+    }
+
+    // move the records of each chromosome to the id ids gives it, which must all differ
+    void remapChroms(const std::map<int, int> &ids) {
+        std::map<int, std::vector<VariantRecord> > remapped;
+        for (std::map<int, std::vector<VariantRecord> >::iterator it = chromRecords.begin(); it != chromRecords.end(); ++it)
+            remapped[ids.find(it->first)->second].swap(it->second);
+        chromRecords.swap(remapped);
+    }
+
+    // memory held by records and alleles
+    uint64_t bytes() const {
+        uint64_t total = alleles.capacity();
+        for (const_iterator it = begin(); it != end(); ++it)
+            total += it->second.capacity() * sizeof(VariantRecord);
+        return total;
+    }
+};
+
+#define FUZZY_MAX_CLUSTER 16 // most variants of a sample or the gold set compared together
+#define FUZZY_MAX_SPAN 1000  // most reference bases of the variants compared together
+
+// Matches sample variants left unmatched by exact matching with gold variants within window bases
+// whose haplotypes are the same, i.e. applying them to the reference around both gives the same
+// sequence. First single variants are paired, with the gold variants near a sample variant found
+// by binary search of a per chromosome index of the unmatched gold variants by position. Then
+// runs of consecutive remaining variants, each within window of the one before, are compared as
+// a whole, so a complex variant split differently in the sample and the gold set also matches.
+// A run is bounded by reference gaps, no variant outside it overlapping its span, and by
+// FUZZY_MAX_CLUSTER and FUZZY_MAX_SPAN. The shortest equivalent run from each variant is taken,
+// so a wider window adds runs without breaking up those found with a narrower one.
+class FuzzyMatcher {
+protected:
+    ParseRefFA *parseRefFA;
+    const ContigDictionary *contigs;
+    uint64_t window;
+    mutable std::atomic<uint64_t> numLimited; // clusters of variants within window beyond the bounds of a run
+
+    // unmatched variants of a chromosome of a store, ordered by position
+    struct Candidates {
+        const VariantStore *store;
+        const std::vector<VariantRecord> *records;
+        std::vector<size_t> index;   // into records
+        std::vector<uint64_t> start; // 0-based start of each
+        uint64_t maxLen;             // longest reference span
+        std::vector<bool> matched;
+
+        Candidates(const VariantStore *store, const std::vector<VariantRecord> *records) : store(store), records(records), maxLen(0) {}
+
+        void add(size_t i) {
+            const VariantRecord &record = (*records)[i];
+            index.push_back(i);
+            start.push_back(record.pos - 1);
+            matched.push_back(false);
+            if (record.srcLen > maxLen)
+                maxLen = record.srcLen;
+        }
+
+        const VariantRecord &record(size_t k) const {
+            return (*records)[index[k]];
+        }
+
+        uint64_t end(size_t k) const {
+            return start[k] + record(k).srcLen;
+        }
+
+        // first candidate that may end at or after pos
+        size_t lowerBound(uint64_t pos) const {
+            uint64_t from = (pos > maxLen) ? pos - maxLen : 0;
+            return std::lower_bound(start.begin(), start.end(), from) - start.begin();
+        }
+    };
+
+    // a variant of a cluster, of the sample or the gold set
+    struct Member {
+        const Candidates *candidates;
+        size_t k;
+        bool operator < (const Member &X) const {
+            return candidates->start[k] < X.candidates->start[X.k];
+        }
+    };
+
+    // the sequence of reference bases [start, end) of refContig with members applied, false if members overlap
+    bool haplotype(int refContig, uint64_t start, uint64_t end, const std::vector<Member> &members, std::string *out) const {
+        std::string bases(end - start, 0);
+        if (parseRefFA->getBases(refContig, start, end - start, &bases[0]) != end - start)
+            return false;
+        out->clear();
+        uint64_t pos = start;
+        for (size_t i=0; i<members.size(); ++i) {
+            const Candidates &c = *members[i].candidates;
+            const VariantRecord &record = c.record(members[i].k);
+            if (c.start[members[i].k] < pos)
+                return false;
+            out->append(bases, pos - start, c.start[members[i].k] - pos);
+            out->append(c.store->allele(record), record.dstLen);
+            pos = c.end(members[i].k);
+        }
+        out->append(bases, pos - start, end - pos);
+        return true;
+    }
+
+    // true if the sample and gold members give the same haplotype
+    bool equivalent(int refContig, std::vector<Member> &sample, std::vector<Member> &gold) const {
+        std::sort(sample.begin(), sample.end());
+        std::sort(gold.begin(), gold.end());
+        uint64_t start = (uint64_t)-1, end = 0;
+        for (int side=0; side<2; ++side) {
+            const std::vector<Member> &members = side ? gold : sample;
+            for (size_t i=0; i<members.size(); ++i) {
+                start = std::min(start, members[i].candidates->start[members[i].k]);
+                end = std::max(end, members[i].candidates->end(members[i].k));
+            }
+        }
+        if (end > parseRefFA->contigLength(refContig))
+            return false;
+        std::string sampleHap, goldHap;
+        return haplotype(refContig, start, end, sample, &sampleHap) && haplotype(refContig, start, end, gold, &goldHap) && sampleHap == goldHap;
+    }
+
+    void pairMatch(int refContig, Candidates &sample, Candidates &gold) const {
+        std::vector<Member> one(1), other(1);
+        for (size_t i=0; i<sample.index.size(); ++i) {
+            uint64_t from = (sample.start[i] > window) ? sample.start[i] - window : 0;
+            uint64_t to = sample.end(i) + window;
+            for (size_t j=gold.lowerBound(from); j<gold.index.size() && gold.start[j] <= to; ++j) {
+                if (gold.matched[j] || gold.end(j) < from)
+                    continue;
+                one[0].candidates = &sample;
+                one[0].k = i;
+                other[0].candidates = &gold;
+                other[0].k = j;
+                if (equivalent(refContig, one, other)) {
+                    sample.matched[i] = true;
+                    gold.matched[j] = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    void clusterMatch(int refContig, Candidates &sample, Candidates &gold) const {
+        std::vector<Member> members;
+        for (int side=0; side<2; ++side) {
+            Candidates &c = side ? gold : sample;
+            for (size_t k=0; k<c.index.size(); ++k) {
+                if (!c.matched[k]) {
+                    Member m;
+                    m.candidates = &c;
+                    m.k = k;
+                    members.push_back(m);
+                }
+            }
+        }
+        std::sort(members.begin(), members.end());
+        std::vector<uint64_t> start(members.size()), end(members.size());
+        for (size_t i=0; i<members.size(); ++i) {
+            start[i] = members[i].candidates->start[members[i].k];
+            end[i] = members[i].candidates->end(members[i].k);
+        }
+
+        // count the clusters chained by window that exceed the bounds of a run
+        for (size_t first = 0; first < members.size(); ) {
+            uint64_t clusterEnd = end[first];
+            size_t last = first+1, numSample = (members[first].candidates == &sample);
+            while (last < members.size() && start[last] <= clusterEnd + window) {
+                clusterEnd = std::max(clusterEnd, end[last]);
+                numSample += (members[last].candidates == &sample);
+                last++;
+            }
+            if (numSample > FUZZY_MAX_CLUSTER || last - first - numSample > FUZZY_MAX_CLUSTER || clusterEnd - start[first] > FUZZY_MAX_SPAN)
+                numLimited++;
+            first = last;
+        }
+
+        uint64_t prevEnd = 0; // of the members before first
+        for (size_t first = 0; first < members.size(); ) {
+            size_t matchedLast = 0;
+            if (prevEnd <= start[first]) {
+                // runs [first, last) from the shortest, ending where the next member starts after the run
+                uint64_t runEnd = end[first];
+                size_t numSample = 0, numGold = 0;
+                for (size_t last = first+1; ; ++last) {
+                    if (members[last-1].candidates == &sample)
+                        numSample++;
+                    else
+                        numGold++;
+                    if (numSample > FUZZY_MAX_CLUSTER || numGold > FUZZY_MAX_CLUSTER || runEnd - start[first] > FUZZY_MAX_SPAN)
+                        break;
+                    bool atGap = (last == members.size() || start[last] >= runEnd);
+                    if (atGap && numSample > 0 && numGold > 0) {
+                        std::vector<Member> sampleMembers, goldMembers;
+                        for (size_t i=first; i<last; ++i) {
+                            if (members[i].candidates == &sample)
+                                sampleMembers.push_back(members[i]);
+                            else
+                                goldMembers.push_back(members[i]);
+                        }
+                        if (equivalent(refContig, sampleMembers, goldMembers)) {
+                            matchedLast = last;
+                            break;
+                        }
+                    }
+                    if (last == members.size() || start[last] > runEnd + window)
+                        break;
+                    runEnd = std::max(runEnd, end[last]);
+                }
+            }
+            if (matchedLast == 0) {
+                prevEnd = std::max(prevEnd, end[first]);
+                first++;
+                continue;
+            }
+            for (size_t i=first; i<matchedLast; ++i) {
+                Candidates &c = (members[i].candidates == &sample) ? sample : gold;
+                c.matched[members[i].k] = true;
+                prevEnd = std::max(prevEnd, end[i]);
+            }
+            first = matchedLast;
+        }
+    }
+
+public:
+    FuzzyMatcher(ParseRefFA *parseRefFA, const ContigDictionary *contigs, uint64_t window) : parseRefFA(parseRefFA), contigs(contigs), window(window), numLimited(0) {}
+
+    // clusters of variants within window of each other, over all matches, with more than
+    // FUZZY_MAX_CLUSTER variants of the sample or of the gold set or spanning more than
+    // FUZZY_MAX_SPAN bases, which were only compared by parts
+    uint64_t numLimitedClusters() const {
+        return numLimited;
+    }
+
+    // match the variants of sample not yet true positives with those of gold not yet set in
+    // goldMatched, marking both. Adds the number of each matched to numSample and numGold.
+    void match(const VariantStore &gold, VariantStore &sample, std::vector<bool> *goldMatched, uint64_t *numSample, uint64_t *numGold) const {
+        uint64_t goldBase = 0;
+        VariantStore::const_iterator sampleIt = sample.begin();
+        for (VariantStore::const_iterator goldIt = gold.begin(); goldIt != gold.end(); goldBase += goldIt->second.size(), ++goldIt) {
+            while (sampleIt != sample.end() && sampleIt->first < goldIt->first)
+                ++sampleIt;
+            if (sampleIt == sample.end())
+                break;
+            int refContig = contigs->refContig(goldIt->first);
+            if (sampleIt->first != goldIt->first || refContig < 0)
+                continue;
+            Candidates sampleCandidates(&sample, &sampleIt->second), goldCandidates(&gold, &goldIt->second);
+            for (size_t i=0; i<sampleIt->second.size(); ++i) {
+                if (!sampleIt->second[i].isTruePositive)
+                    sampleCandidates.add(i);
+            }
+            for (size_t j=0; j<goldIt->second.size(); ++j) {
+                if (!(*goldMatched)[goldBase + j])
+                    goldCandidates.add(j);
+            }
+            pairMatch(refContig, sampleCandidates, goldCandidates);
+            clusterMatch(refContig, sampleCandidates, goldCandidates);
+            for (size_t k=0; k<sampleCandidates.index.size(); ++k) {
+                if (sampleCandidates.matched[k]) {
+                    sample.markTruePositive(sampleIt->first, sampleCandidates.index[k]);
+                    (*numSample)++;
+                }
+            }
+            for (size_t k=0; k<goldCandidates.index.size(); ++k) {
+                if (goldCandidates.matched[k]) {
+                    (*goldMatched)[goldBase + goldCandidates.index[k]] = true;
+                    (*numGold)++;
+                }
+            }
+        }
+    }
+};
+
+// Score (QUAL) of a variant and whether it is in the gold set
+struct ScoredVariant {
+    double score;
+    bool isTruePositive;
+
+    inline bool operator < (const ScoredVariant &X) const {
+        return score > X.score; // highest score first
+    }
+};
+
+// Accuracy of a sample at each score threshold, from its scored variants sorted once by score
+// and counted cumulatively in one scan
+class ROCCurve {
+public:
+    struct Point {
+        double score; // variants with at least this score are called
+        uint64_t truePositives;
+        uint64_t falsePositives;
+    };
+
+    std::vector<Point> points; // at each distinct score, highest score first
+
+    // sorts variants
+    void build(std::vector<ScoredVariant> &variants) {
+        std::sort(variants.begin(), variants.end());
+        points.clear();
+        for (size_t i=0; i<variants.size(); ++i)
+            add(variants[i]);
+    }
+
+    // count the next variant, given in order of score highest first
+    void add(const ScoredVariant &variant) {
+        if (points.empty() || points.back().score != variant.score) {
+            Point point;
+            point.score = variant.score;
+            point.truePositives = points.empty() ? 0 : points.back().truePositives;
+            point.falsePositives = points.empty() ? 0 : points.back().falsePositives;
+            points.push_back(point);
+        }
+        if (variant.isTruePositive)
+            points.back().truePositives++;
+        else
+            points.back().falsePositives++;
+    }
+
+    // the ROC curve as (false positives, true positives) with the most true positives at each
+    // number of false positives, in order of false positives
+    void rocPoints(std::vector<std::pair<uint64_t, uint64_t> > *roc) const {
+        roc->clear();
+        for (size_t i=0; i<points.size(); ++i) {
+            if (i+1 == points.size() || points[i+1].falsePositives != points[i].falsePositives)
+                roc->push_back(std::make_pair(points[i].falsePositives, points[i].truePositives));
+        }
+    }
+
+    // ROC AUC by the trapezoidal rule, with the curve extended from its last point to
+    // (maxFalsePositives, numPositives) and both axes normalised by those. The returned plot is
+    // the curve from (0,0) to that end point, for interpolation.
+    double auc(uint64_t numPositives, uint64_t maxFalsePositives, std::vector<std::pair<uint64_t, uint64_t> > *plot) const {
+        std::vector<std::pair<uint64_t, uint64_t> > &roc = *plot;
+        rocPoints(&roc);
+        double area = 0.0;
+        uint64_t prevTruePos = 0;
+        uint64_t prevFalsePos = 0;
+        for (size_t i=0; i<roc.size(); ++i) {
+            area += ((double)(roc[i].second + prevTruePos) * (double)(roc[i].first - prevFalsePos)) / 2.0;
+            prevTruePos = roc[i].second;
+            prevFalsePos = roc[i].first;
+        }
+        // the plot starts at (0,0), also when there are true positives without false positives
+        if (roc.empty() || roc[0].first != 0)
+            roc.insert(roc.begin(), std::make_pair((uint64_t)0, (uint64_t)0));
+        roc[0].second = 0;
+        area += ((double)(numPositives + roc.back().second) * (double)(maxFalsePositives - roc.back().first)) / 2.0;
+        if (roc.back().first == maxFalsePositives)
+            roc.back().second = numPositives;
+        else
+            roc.push_back(std::make_pair(maxFalsePositives, numPositives));
+        area /= numPositives;
+        area /= maxFalsePositives;
+        return area;
+    }
+
+    // area under the precision-recall curve as average precision, the sum over thresholds of
+    // precision times the increase in recall
+    double aucPR(uint64_t trueSetSize) const {
+        double area = 0.0;
+        uint64_t prevTruePos = 0;
+        for (size_t i=0; i<points.size(); ++i) {
+            double precision = (double)points[i].truePositives / (double)(points[i].truePositives + points[i].falsePositives);
+            area += precision * (double)(points[i].truePositives - prevTruePos) / (double)trueSetSize;
+            prevTruePos = points[i].truePositives;
+        }
+        return area;
+    }
+
+    // F-score calling only the variants of point i and above
+    double fscore(size_t i, uint64_t trueSetSize) const {
+        uint64_t falseNegatives = trueSetSize - points[i].truePositives;
+        return (double)(2*points[i].truePositives) / (double)(2*points[i].truePositives + points[i].falsePositives + falseNegatives);
+    }
+
+    // index of the point with the highest F-score, the highest threshold on ties
+    size_t bestFScore(uint64_t trueSetSize) const {
+        size_t best = 0;
+        for (size_t i=1; i<points.size(); ++i) {
+            if (fscore(i, trueSetSize) > fscore(best, trueSetSize))
+                best = i;
+        }
+        return best;
+    }
+
+    // write the precision-recall curve, a line per threshold
+    void writePR(FILE *out, const char *name, uint64_t trueSetSize) const {
+        for (size_t i=0; i<points.size(); ++i) {
+            fprintf(out, "%s\t%lf\t%lf\t%lf\t%lf\n", name, points[i].score,
+                (double)points[i].truePositives / (double)(points[i].truePositives + points[i].falsePositives),
+                (double)points[i].truePositives / (double)trueSetSize, fscore(i, trueSetSize));
+        }
+    }
+};
+
+// Regions of a BED file, to which both the gold set and the samples are restricted
+struct BedRegion {
+    std::string chrom;
+    uint64_t start; // 0-based
+    uint64_t end;   // exclusive
+};
+
+class RegionSet {
+protected:
+    std::vector<BedRegion> regions;
+    std::map<int, std::vector<std::pair<uint64_t, uint64_t> > > chromRegions; // sorted and merged, by chromosome id
+
+public:
+    bool read(const std::string &filename) {
+        FILE *in = fopen(filename.c_str(), "r");
+        if (in == NULL)
+            return false;
+        char line[65536];
+        while (fgets(line, sizeof(line), in)) {
+            if (line[0] == '#' || strncmp(line, "track", 5) == 0 || strncmp(line, "browser", 7) == 0)
+                continue;
+            char *saveptr;
+            char *chrom = strtok_r(line, " \t\r\n", &saveptr);
+            char *start = strtok_r(NULL, " \t\r\n", &saveptr);
+            char *end = strtok_r(NULL, " \t\r\n", &saveptr);
+            if (end == NULL)
+                continue;
+            BedRegion region;
+            region.chrom = chrom;
+            region.start = strtoull(start, NULL, 10);
+            region.end = strtoull(end, NULL, 10);
+            if (region.end > region.start)
+                regions.push_back(region);
+        }
+        fclose(in);
+        return true;
+    }
+
+    // resolve the chromosome names to contig ids, regions on other chromosomes are dropped
+    void index(const ContigDictionary &contigs) {
+        chromRegions.clear();
+        for (std::vector<BedRegion>::const_iterator it = regions.begin(); it != regions.end(); ++it) {
+            int chrom = contigs.find(it->chrom);
+            if (chrom >= 0)
+                chromRegions[chrom].push_back(std::make_pair(it->start, it->end));
+        }
+        for (std::map<int, std::vector<std::pair<uint64_t, uint64_t> > >::iterator it = chromRegions.begin(); it != chromRegions.end(); ++it) {
+            std::vector<std::pair<uint64_t, uint64_t> > &intervals = it->second;
+            std::sort(intervals.begin(), intervals.end());
+            size_t n = 0;
+            for (size_t i=0; i<intervals.size(); ++i) {
+                if (n > 0 && intervals[i].first <= intervals[n-1].second) {
+                    if (intervals[i].second > intervals[n-1].second)
+                        intervals[n-1].second = intervals[i].second;
+                }
+                else {
+                    intervals[n++] = intervals[i];
+                }
+            }
+            intervals.resize(n);
+        }
+    }
+
+    // true if [start, end) (0-based) overlaps a region of chromosome chrom
+    bool overlaps(int chrom, uint64_t start, uint64_t end) const {
+        std::map<int, std::vector<std::pair<uint64_t, uint64_t> > >::const_iterator it = chromRegions.find(chrom);
+        if (it == chromRegions.end())
+            return false;
+        const std::vector<std::pair<uint64_t, uint64_t> > &intervals = it->second;
+        if (end <= start)
+            end = start+1;
+        // last region starting before end
+        std::vector<std::pair<uint64_t, uint64_t> >::const_iterator found = std::lower_bound(intervals.begin(), intervals.end(), std::make_pair(end, (uint64_t)0));
+        if (found == intervals.begin())
+            return false;
+        --found;
+        return found->second > start;
+    }
+
+    const std::vector<BedRegion> &all() const {
+        return regions;
+    }
+
+    // identifies the regions once indexed by contigs, by contig name rather than id
+    uint64_t identity(const ContigDictionary &contigs) const {
+        uint64_t h = chromRegions.size();
+        for (std::map<int, std::vector<std::pair<uint64_t, uint64_t> > >::const_iterator it = chromRegions.begin(); it != chromRegions.end(); ++it) {
+            const std::string &name = contigs.name(it->first);
+            h = hash64(name.data(), name.size(), h);
+            h = hash64(&it->second[0], it->second.size() * sizeof(it->second[0]), h);
+        }
+        return h;
+    }
+};
+
+#define VCF_NUM_FIELDS 6 // fields of a VCF line used, up to QUAL
+
+// end of the VCF field at p, i.e. the first tab, space or newline from p or end if none, 16 bytes at a time
+static inline const char *vcfFieldEnd(const char *p, const char *end) {
+#ifdef __SSE2__
+    const __m128i tab = _mm_set1_epi8('\t'), space = _mm_set1_epi8(' '), newline = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+        __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, tab), _mm_cmpeq_epi8(bytes, space)), _mm_cmpeq_epi8(bytes, newline));
+        int mask = _mm_movemask_epi8(found);
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+#endif
+    while (p < end && *p != '\t' && *p != ' ' && *p != '\n')
+        ++p;
+    return p;
+}
+
+// splits the line at begin, of a chunk ending at end, into at most maxFields fields as strtok_r with
+// " \t" would and returns their number, 0 for a header line. *next is set to the start of the next line.
+static unsigned int tokenizeVCFLine(const char *begin, const char *end, unsigned int maxFields, const char **field, const char **fieldEnd, const char **next) {
+    unsigned int numFields = 0;
+    const char *p = begin;
+    if (*p != '#') {
+        while (numFields < maxFields) {
+            while (p < end && (*p == ' ' || *p == '\t'))
+                ++p;
+            if (p == end || *p == '\n')
+                break;
+            field[numFields] = p;
+            p = vcfFieldEnd(p, end);
+            fieldEnd[numFields++] = p;
+        }
+    }
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    *next = (eol == NULL) ? end : eol+1;
+    return numFields;
+}
+
+// POS field [p, end) as atol would parse it, digits only are parsed here and anything else by atol
+static uint64_t parseVCFPos(const char *p, const char *end) {
+    uint64_t value = 0;
+    const char *q = p;
+    while (q < end && q - p < 18 && *q >= '0' && *q <= '9')
+        value = value*10 + (*q++ - '0');
+    if (q == end && q > p)
+        return value;
+    return atol(std::string(p, end).c_str());
+}
+
+// QUAL field [p, end) as atof would parse it. A decimal of at most 15 significant digits is exact as
+// an integer and as a power of 10 up to 1e22, so dividing them rounds the same as strtod.
+// Anything else, e.g. an exponent or ".", is parsed by strtod.
+static double parseVCFQual(const char *p, const char *end) {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char *q = p;
+    bool negative = (q < end && *q == '-');
+    if (negative)
+        ++q;
+    uint64_t mantissa = 0;
+    unsigned int digits = 0, decimals = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; ++q, ++digits)
+        mantissa = mantissa*10 + (*q - '0');
+    if (q < end && *q == '.') {
+        for (++q; q < end && *q >= '0' && *q <= '9'; ++q, ++digits, ++decimals)
+            mantissa = mantissa*10 + (*q - '0');
+    }
+    if (q == end && digits > 0 && digits <= 15) {
+        double value = (double)mantissa / powers[decimals];
+        return negative ? -value : value;
+    }
+    return strtod(std::string(p, end).c_str(), NULL);
+}
+
+// Chromosome, position, ID, Ref, [Alt,...], Quality, Filter
+class VCFParser {
+protected:
+    const ContigDictionary *contigs;
+    std::set<std::string> ignoredChrom;
+    uint64_t countTruePositives;
+    uint64_t countGoldTruePositives;
+
+    // parses the line at begin of a chunk ending at end and returns the start of the next line. Only
+    // the fields up to QUAL are tokenized, as strtok_r with " \t" would, the rest of the line is not.
+    // Adds the seconds spent normalising to *normalizeSeconds if given
+    const char *parseLine(const int compareType, const char *begin, const char *end, ContigLookup &lookup, VariantNormalizer &normalizer, const RegionSet *regions, VariantStore &store, std::set<std::string> &ignored, double *normalizeSeconds) const {
+        // chromosome, position, ID, ref, alts and quality
+        const char *field[VCF_NUM_FIELDS], *fieldEnd[VCF_NUM_FIELDS];
+        const char *next;
+        if (tokenizeVCFLine(begin, end, VCF_NUM_FIELDS, field, fieldEnd, &next) < VCF_NUM_FIELDS)
+            return next;
+
+        int chromId = lookup.find(field[0], fieldEnd[0] - field[0]);
+        if (chromId < 0) {
+            if (ignored.insert(std::string(field[0], fieldEnd[0])).second) {
+                //printf("Warning - unable to find chromosome [%.*s]\n", (int)(fieldEnd[0]-field[0]), field[0]);
+            }
+            return next;
+        }
+        uint64_t pos = parseVCFPos(field[1], fieldEnd[1]);
+        const char *ref = field[3];
+        unsigned int refLen = fieldEnd[3] - ref;
+        if (regions != NULL && !regions->overlaps(chromId, pos-1, pos-1+refLen))
+            return next;
+        double qual = parseVCFQual(field[5], fieldEnd[5]);
+        for (const char *alt = field[4]; alt < fieldEnd[4]; ) {
+            const char *altEnd = (const char *)memchr(alt, ',', fieldEnd[4] - alt);
+            if (altEnd == NULL)
+                altEnd = fieldEnd[4];
+            unsigned int altLen = altEnd - alt;
+            const char *nextAlt = altEnd + 1;
+            if (altLen == 0) {
+                alt = nextAlt;
+                continue;
+            }
+            if (normalizeSeconds != NULL) {
+                double start = wallSeconds();
+                normalizer.normalize(chromId, pos, ref, refLen, alt, altLen);
+                *normalizeSeconds += wallSeconds() - start;
+            }
+            else {
+                normalizer.normalize(chromId, pos, ref, refLen, alt, altLen);
+            }
+            alt = nextAlt;
+            bool isSNP = (normalizer.srcLen == 1 && normalizer.dstLen == 1);
+            if (compareType == COMPARE_SNP && !isSNP)
+                continue;
+            if (compareType == COMPARE_INDEL && isSNP)
+                continue;
+            store.add(chromId, normalizer.pos, normalizer.srcLen, normalizer.dst, normalizer.dstLen, qual);
+        }
+        return next;
+    }
+
+public:
+    VariantStore variantDB;
+
+    VCFParser(const ContigDictionary *contigs) : contigs(contigs) {
+        countTruePositives = 0;
+        countGoldTruePositives = 0;
+    }
+    
+    size_t size() const {
+        return variantDB.size();
+    }
+
+    const ContigDictionary &getContigs() const {
+        return *contigs;
+    }
+
+    const std::set<std::string> &getIgnoredChrom() const {
+        return ignoredChrom;
+    }
+    
+    uint64_t numTruePositives() const {
+        return countTruePositives;
+    }
+
+    // gold set variants found, the same as numTruePositives() unless matched fuzzily
+    uint64_t numGoldTruePositives() const {
+        return countGoldTruePositives;
+    }
+    
+    // parse the whole lines in [begin, end), timing normalisation into *normalizeSeconds if given
+    void parseChunk(const int compareType, const char *begin, const char *end, ParseRefFA *parseRefFA, const RegionSet *regions, VariantStore &store, std::set<std::string> &ignored, double *normalizeSeconds = NULL) const {
+        ContigLookup lookup(contigs);
+        VariantNormalizer normalizer(parseRefFA, contigs);
+        while (begin < end)
+            begin = parseLine(compareType, begin, end, lookup, normalizer, regions, store, ignored, normalizeSeconds);
+    }
+
+    // add the variants parsed from chunks of the file, in order of the chunks
+    void addChunk(const VariantStore &store, const std::set<std::string> &ignored) {
+        variantDB.append(store);
+        ignoredChrom.insert(ignored.begin(), ignored.end());
+    }
+
+    bool parseFile(const int compareType, const std::string &filename, ParseRefFA *parseRefFA = NULL, unsigned int numThreads = 1);
+
+    // find the true positives of this sample in the gold set, see VariantStore::match, then any
+    // more with fuzzy if given, replacing those of an earlier gold set
+    void matchTruePositives(const VCFParser &positiveSet, std::vector<bool> *positiveVariants = NULL, const FuzzyMatcher *fuzzy = NULL) {
+        variantDB.clearMatches();
+        countTruePositives = variantDB.match(positiveSet.variantDB, positiveVariants);
+        countGoldTruePositives = countTruePositives;
+        if (fuzzy != NULL) {
+            std::vector<bool> goldMatched;
+            if (positiveVariants == NULL) {
+                goldMatched.resize(positiveSet.size());
+                variantDB.match(positiveSet.variantDB, &goldMatched);
+                positiveVariants = &goldMatched;
+            }
+            fuzzy->match(positiveSet.variantDB, variantDB, positiveVariants, &countTruePositives, &countGoldTruePositives);
+        }
+    }
+
+    // the score and true positive flag of every variant, once matched against the gold set
+    void getScoredVariants(std::vector<ScoredVariant> *scored) const {
+        scored->clear();
+        scored->reserve(variantDB.size());
+        for (VariantStore::const_iterator chromIt = variantDB.begin(); chromIt != variantDB.end(); ++chromIt) {
+            const std::vector<VariantRecord> &records = chromIt->second;
+            for (std::vector<VariantRecord>::const_iterator it = records.begin(); it != records.end(); ++it) {
+                ScoredVariant variant;
+                variant.score = it->qual;
+                variant.isTruePositive = it->isTruePositive;
+                scored->push_back(variant);
+            }
+        }
+    }
+};
+
+// Block of a BGZF file (blocked gzip as written by bgzip)
+struct BGZFBlock {
+    uint64_t offset;   // file offset of the block
+    uint32_t size;     // compressed size including header and footer
+    uint32_t dataSize; // uncompressed size
+};
+
+// size of the BGZF block at data, 0 if it is not a BGZF block
+static uint32_t bgzfBlockSize(const uint8_t *data, uint64_t size) {
+    if (size < 18 || data[0] != 0x1f || data[1] != 0x8b || data[2] != 8 || !(data[3] & 4))
+        return 0;
+    unsigned int xlen = data[10] | (data[11] << 8);
+    for (unsigned int i=12; i+4 <= 12+xlen && i+4 <= size; ) {
+        unsigned int fieldLen = data[i+2] | (data[i+3] << 8);
+        if (data[i] == 'B' && data[i+1] == 'C' && fieldLen == 2 && i+6 <= size) {
+            uint32_t blockSize = (data[i+4] | (data[i+5] << 8)) + 1;
+            return (blockSize <= size) ? blockSize : 0;
+        }
+        i += 4 + fieldLen;
+    }
+    return 0;
+}
+
+static bool bgzfBlock(const uint8_t *data, uint64_t size, uint64_t offset, BGZFBlock *block) {
+    if (offset >= size)
+        return false;
+    block->offset = offset;
+    block->size = bgzfBlockSize(data + offset, size - offset);
+    if (block->size < 26)
+        return false;
+    const uint8_t *footer = data + offset + block->size - 4;
+    block->dataSize = footer[0] | (footer[1] << 8) | (footer[2] << 16) | ((uint32_t)footer[3] << 24);
+    return true;
+}
+
+// inflate a BGZF block into out, which holds block.dataSize bytes
+static bool bgzfInflate(const uint8_t *data, const BGZFBlock &block, char *out) {
+    const uint8_t *p = data + block.offset;
+    unsigned int headerSize = 12 + (p[10] | (p[11] << 8));
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK)
+        return false;
+    zs.next_in = (Bytef *)(p + headerSize);
+    zs.avail_in = block.size - headerSize - 8;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = block.dataSize;
+    int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END && zs.avail_out == 0;
+}
+
+// inflate any gzip data, of one or more members
+static bool gunzip(const uint8_t *data, uint64_t size, std::string *out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15+32) != Z_OK)
+        return false;
+    char buf[65536];
+    uint64_t pos = 0;
+    int ret = Z_OK;
+    for (;;) {
+        if (zs.avail_in == 0) {
+            if (pos == size)
+                break;
+            uInt len = (size - pos > (1u << 30)) ? (1u << 30) : (uInt)(size - pos);
+            zs.next_in = (Bytef *)(data + pos);
+            zs.avail_in = len;
+            pos += len;
+        }
+        zs.next_out = (Bytef *)buf;
+        zs.avail_out = sizeof(buf);
+        ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END)
+            break;
+        out->append(buf, sizeof(buf) - zs.avail_out);
+        if (ret == Z_STREAM_END && inflateReset(&zs) != Z_OK) // next member, if any
+            break;
+    }
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+// tabix index (.tbi) of a BGZF file, as needed to find the blocks overlapping regions
+class TabixIndex {
+protected:
+    typedef std::pair<uint64_t, uint64_t> Chunk; // virtual offsets, begin and end
+
+    struct Reference {
+        std::map<uint32_t, std::vector<Chunk> > bins;
+        std::vector<uint64_t> linear; // smallest virtual offset of each 16 kb window
+    };
+
+    std::map<std::string, unsigned int> names;
+    std::vector<Reference> references;
+
+    static bool readInt(gzFile in, void *value, unsigned int len) {
+        return gzread(in, value, len) == (int)len;
+    }
+
+public:
+    bool read(const std::string &filename) {
+        gzFile in = gzopen(filename.c_str(), "rb");
+        if (in == NULL)
+            return false;
+        char magic[4];
+        int32_t numRefs, header[6], namesLen;
+        bool ok = readInt(in, magic, 4) && memcmp(magic, "TBI\1", 4) == 0
+            && readInt(in, &numRefs, 4) && readInt(in, header, sizeof(header)) && readInt(in, &namesLen, 4) && namesLen >= 0;
+        std::vector<char> nameBuf(namesLen+1, 0);
+        ok = ok && readInt(in, &nameBuf[0], namesLen);
+        // the names are in order of the references, each ending with a 0
+        for (int32_t i=0, start=0, ref=0; ok && i<namesLen; ++i) {
+            if (nameBuf[i] == 0) {
+                names[std::string(&nameBuf[start])] = ref++;
+                start = i+1;
+            }
+        }
+        references.resize(ok ? numRefs : 0);
+        for (int32_t i=0; ok && i<numRefs; ++i) {
+            int32_t numBins;
+            ok = readInt(in, &numBins, 4);
+            for (int32_t j=0; ok && j<numBins; ++j) {
+                uint32_t bin;
+                int32_t numChunks;
+                ok = readInt(in, &bin, 4) && readInt(in, &numChunks, 4) && numChunks >= 0;
+                if (!ok)
+                    break;
+                std::vector<Chunk> &chunks = references[i].bins[bin];
+                chunks.resize(numChunks);
+                for (int32_t k=0; ok && k<numChunks; ++k)
+                    ok = readInt(in, &chunks[k].first, 8) && readInt(in, &chunks[k].second, 8);
+            }
+            int32_t numIntervals;
+            ok = ok && readInt(in, &numIntervals, 4) && numIntervals >= 0;
+            if (ok) {
+                references[i].linear.resize(numIntervals);
+                ok = numIntervals == 0 || readInt(in, &references[i].linear[0], 8*numIntervals);
+            }
+        }
+        gzclose(in);
+        return ok;
+    }
+
+    // id of a sequence name, trying it with and without a "chr" prefix, -1 if not indexed
+    int referenceId(const std::string &chrom) const {
+        std::map<std::string, unsigned int>::const_iterator it = names.find(chrom);
+        if (it == names.end())
+            it = names.find((chrom.compare(0, 3, "chr") == 0) ? chrom.substr(3) : "chr" + chrom);
+        return (it == names.end()) ? -1 : (int)it->second;
+    }
+
+    // add the chunks that may hold records overlapping [begin, end) (0-based) of reference id
+    void query(int id, uint64_t begin, uint64_t end, std::vector<Chunk> *chunks) const {
+        if (id < 0 || id >= (int)references.size() || end <= begin)
+            return;
+        const Reference &ref = references[id];
+        if (begin >= (1ull << 29))
+            return;
+        if (end > (1ull << 29))
+            end = 1ull << 29;
+        uint64_t minOffset = 0;
+        if (!ref.linear.empty())
+            minOffset = ref.linear[std::min<uint64_t>(begin >> 14, ref.linear.size()-1)];
+        // bins of the standard binning scheme, levels of 512 Mb down to 16 kb
+        static const unsigned int firstBin[6] = { 0, 1, 9, 73, 585, 4681 };
+        static const unsigned int shift[6] = { 29, 26, 23, 20, 17, 14 };
+        for (int level=0; level<6; ++level) {
+            for (uint64_t k = firstBin[level] + (begin >> shift[level]); k <= firstBin[level] + ((end-1) >> shift[level]); ++k) {
+                std::map<uint32_t, std::vector<Chunk> >::const_iterator it = ref.bins.find(k);
+                if (it == ref.bins.end())
+                    continue;
+                for (std::vector<Chunk>::const_iterator chunk = it->second.begin(); chunk != it->second.end(); ++chunk) {
+                    if (chunk->second > minOffset)
+                        chunks->push_back(*chunk);
+                }
+            }
+        }
+    }
+};
+
+#define BGZF_BLOCKS_PER_TASK 64
+
+// Contents of a VCF file, mmap'd when it is a regular file and read into memory otherwise.
+// gzip and BGZF input is decompressed, BGZF blocks in parallel. With regions and a tabix index
+// only the blocks that may hold records in the regions are decompressed.
+class VCFBuffer {
+protected:
+    const char *mapped;
+    std::string contents;
+    uint64_t mappedSize;
+
+    struct InflateTask {
+        const uint8_t *data;
+        std::vector<BGZFBlock> blocks;
+        std::vector<uint64_t> outOffsets;
+        char *out;
+        std::atomic<bool> ok;
+
+        void operator()(unsigned int i) {
+            for (size_t j = i*BGZF_BLOCKS_PER_TASK; j < blocks.size() && j < (i+1)*BGZF_BLOCKS_PER_TASK; ++j) {
+                if (!bgzfInflate(data, blocks[j], out + outOffsets[j]))
+                    ok = false;
+            }
+        }
+    };
+
+    // contents of the tabix chunks, each given as the byte range [first, second) within blocks
+    struct ChunkTask {
+        const uint8_t *data;
+        uint64_t size;
+        std::vector<std::pair<uint64_t, uint64_t> > chunks; // virtual offsets
+        std::vector<std::string> out;
+        std::atomic<bool> ok;
+
+        void operator()(unsigned int i) {
+            uint64_t offset = chunks[i].first >> 16;
+            uint64_t endOffset = chunks[i].second >> 16;
+            unsigned int skip = chunks[i].first & 0xffff;
+            unsigned int endData = chunks[i].second & 0xffff;
+            std::vector<char> buf;
+            BGZFBlock block;
+            while (offset <= endOffset && bgzfBlock(data, size, offset, &block)) {
+                buf.resize(block.dataSize + 1);
+                if (!bgzfInflate(data, block, &buf[0])) {
+                    ok = false;
+                    return;
+                }
+                unsigned int len = (offset == endOffset && endData < block.dataSize) ? endData : block.dataSize;
+                if (len > skip)
+                    out[i].append(&buf[skip], len - skip);
+                skip = 0;
+                offset += block.size;
+            }
+        }
+    };
+
+    bool inflateAll(const uint8_t *data, uint64_t size, unsigned int numThreads) {
+        InflateTask task;
+        task.data = data;
+        BGZFBlock block;
+        uint64_t total = 0;
+        for (uint64_t offset = 0; offset < size; offset += block.size) {
+            if (!bgzfBlock(data, size, offset, &block)) {
+                task.blocks.clear();
+                break;
+            }
+            task.blocks.push_back(block);
+            task.outOffsets.push_back(total);
+            total += block.dataSize;
+        }
+        if (task.blocks.empty())
+            return gunzip(data, size, &contents); // plain gzip
+        contents.resize(total);
+        task.out = &contents[0];
+        task.ok = true;
+        parallelFor((task.blocks.size() + BGZF_BLOCKS_PER_TASK - 1) / BGZF_BLOCKS_PER_TASK, numThreads, task);
+        return task.ok;
+    }
+
+    bool inflateRegions(const uint8_t *data, uint64_t size, const TabixIndex &index, const RegionSet &regions, unsigned int numThreads) {
+        ChunkTask task;
+        task.data = data;
+        task.size = size;
+        for (std::vector<BedRegion>::const_iterator it = regions.all().begin(); it != regions.all().end(); ++it)
+            index.query(index.referenceId(it->chrom), it->start, it->end, &task.chunks);
+        // merge overlapping chunks, keeping file order
+        std::sort(task.chunks.begin(), task.chunks.end());
+        size_t n = 0;
+        for (size_t i=0; i<task.chunks.size(); ++i) {
+            if (n > 0 && task.chunks[i].first <= task.chunks[n-1].second) {
+                if (task.chunks[i].second > task.chunks[n-1].second)
+                    task.chunks[n-1].second = task.chunks[i].second;
+            }
+            else {
+                task.chunks[n++] = task.chunks[i];
+            }
+        }
+        task.chunks.resize(n);
+        task.out.resize(n);
+        task.ok = true;
+        parallelFor(n, numThreads, task);
+        for (size_t i=0; i<n; ++i) {
+            contents.append(task.out[i]);
+            std::string().swap(task.out[i]);
+        }
+        return task.ok;
+    }
+
+public:
+    VCFBuffer() {
+        mapped = NULL;
+        mappedSize = 0;
+    }
+
+    ~VCFBuffer() {
+        if (mapped != NULL)
+            munmap((void *)mapped, mappedSize);
+    }
+
+    // regions, if given, are used to read only part of a BGZF file with a tabix index
+    bool open(const std::string &filename, unsigned int numThreads = 1, const RegionSet *regions = NULL) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                mapped = (const char *)p;
+                mappedSize = st.st_size;
+            }
+        }
+        if (mapped == NULL) {
+            char buf[65536];
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) > 0)
+                contents.append(buf, n);
+            if (n < 0) {
+                int err = errno;
+                close(fd);
+                errno = err;
+                return false;
+            }
+        }
+        close(fd);
+
+        const uint8_t *data = (const uint8_t *)this->data();
+        uint64_t size = this->size();
+        if (size < 2 || data[0] != 0x1f || data[1] != 0x8b)
+            return true;
+        // compressed, the contents are replaced by the decompressed data
+        std::string compressed;
+        if (mapped == NULL) {
+            compressed.swap(contents);
+            data = (const uint8_t *)compressed.data();
+        }
+        TabixIndex index;
+        bool ok;
+        if (regions != NULL && bgzfBlockSize(data, size) != 0 && index.read(filename + ".tbi"))
+            ok = inflateRegions(data, size, index, *regions, numThreads);
+        else
+            ok = inflateAll(data, size, numThreads);
+        if (mapped != NULL) {
+            munmap((void *)mapped, mappedSize);
+            mapped = NULL;
+            mappedSize = 0;
+        }
+        if (!ok)
+            errno = EINVAL;
+        return ok;
+    }
+
+    const char *data() const {
+        return (mapped != NULL) ? mapped : contents.data();
+    }
+
+    uint64_t size() const {
+        return (mapped != NULL) ? mappedSize : contents.size();
+    }
+};
+
+#define VARIANT_CACHE_MAGIC "GMVCACHE"
+#define VARIANT_CACHE_VERSION 3
+#define VARIANT_CACHE_SIZE 4096 // MB of entries kept by default, the least recently used removed beyond
+
+// Cache of the normalised and deduplicated variants of VCF files, one file per VCF in a cache
+// directory. An entry is only used when the VCF size, modification time and content hash, the
+// reference, the regions and the compare type all match those it was written with, and the
+// contigs of its variants and its ignored chromosome names resolve as they did (see
+// ContigDictionary::resolution). Contig ids are stored with their names and remapped on loading,
+// so adding contigs of other VCFs to the dictionary does not invalidate an entry.
+class VariantCache {
+protected:
+    struct Key {
+        char magic[8];
+        uint32_t version;
+        int32_t compareType;
+        uint64_t fileSize;
+        int64_t mtime;
+        int64_t mtimeNsec;
+        uint64_t contentHash;
+        uint64_t referenceId;
+        uint64_t regionsId;
+    };
+
+    std::string directory;
+    int compareType;
+    uint64_t referenceId;
+    const ContigDictionary *contigs;
+    uint64_t regionsId;
+    uint64_t maxBytes;
+    mutable std::atomic<bool> writeFailed; // reported once
+
+    bool makeKey(const std::string &filename, Key *key) const {
+        memset(key, 0, sizeof(Key));
+        memcpy(key->magic, VARIANT_CACHE_MAGIC, 8);
+        key->version = VARIANT_CACHE_VERSION;
+        key->compareType = compareType;
+        key->referenceId = referenceId;
+        key->regionsId = regionsId;
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            return false;
+        }
+        key->fileSize = st.st_size;
+        key->mtime = st.st_mtim.tv_sec;
+        key->mtimeNsec = st.st_mtim.tv_nsec;
+        key->contentHash = 0;
+        if (st.st_size > 0) {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                return false;
+            }
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            key->contentHash = hash64(p, st.st_size);
+            munmap(p, st.st_size);
+        }
+        close(fd);
+        return true;
+    }
+
+    std::string entryName(const Key &key) const {
+        char name[64];
+        snprintf(name, sizeof(name), "/%016" PRIx64 ".gmvc", hash64(&key, sizeof(key)));
+        return directory + name;
+    }
+
+public:
+    // the zero terminated strings of a block of length len at data + *offset, past which *offset
+    // is moved. False if the block is truncated
+    static bool readNames(const uint8_t *data, uint64_t size, uint64_t *offset, std::vector<std::string> *names) {
+        uint64_t len;
+        if (size - *offset < sizeof(len))
+            return false;
+        memcpy(&len, data + *offset, sizeof(len));
+        *offset += sizeof(len);
+        if (len > size - *offset)
+            return false;
+        for (uint64_t i=0, start=0; i<len; ++i) {
+            if (data[*offset+i] == 0) {
+                names->push_back(std::string((const char *)data + *offset + start, i - start));
+                start = i+1;
+            }
+        }
+        *offset += len;
+        return true;
+    }
+
+    static bool writeNames(FILE *out, const std::vector<std::string> &names) {
+        std::string block;
+        for (size_t i=0; i<names.size(); ++i) {
+            block.append(names[i]);
+            block.push_back(0);
+        }
+        uint64_t len = block.size();
+        return fwrite(&len, sizeof(len), 1, out) == 1 && fwrite(block.data(), 1, block.size(), out) == block.size();
+    }
+
+public:
+    VariantCache(const std::string &directory, const int compareType, uint64_t referenceId, const ContigDictionary *contigs, uint64_t regionsId, uint64_t maxBytes)
+        : directory(directory), compareType(compareType), referenceId(referenceId), contigs(contigs), regionsId(regionsId), maxBytes(maxBytes), writeFailed(false) {}
+
+    // create the directory if it does not exist, false with errno set if it cannot be written
+    bool openDirectory() const {
+        if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST)
+            return false;
+        return access(directory.c_str(), W_OK | X_OK) == 0;
+    }
+
+    // fill parser with the cached variants of filename, false if there is no valid entry
+    bool load(const std::string &filename, VCFParser *parser) const {
+        Key key;
+        if (!makeKey(filename, &key))
+            return false;
+        int fd = open(entryName(key).c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        void *p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(Key) + sizeof(uint64_t))
+            p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        const uint8_t *data = (const uint8_t *)p;
+        bool ok = memcmp(data, &key, sizeof(Key)) == 0;
+        uint64_t offset = sizeof(Key);
+        // ignored chromosome names, the resolution of the contig of each chromosome, then the variant store
+        std::vector<std::string> ignored, resolutions;
+        ok = ok && readNames(data, st.st_size, &offset, &ignored) && readNames(data, st.st_size, &offset, &resolutions);
+        ok = ok && parser->variantDB.read(data + offset, st.st_size - offset);
+        munmap(p, st.st_size);
+        for (size_t i=0; ok && i<ignored.size(); ++i)
+            ok = contigs->find(ignored[i]) < 0;
+        std::map<int, int> ids;
+        ok = ok && resolutions.size() == parser->variantDB.numChroms();
+        size_t i = 0;
+        for (VariantStore::const_iterator it = parser->variantDB.begin(); ok && it != parser->variantDB.end(); ++it, ++i) {
+            const std::string &resolution = resolutions[i];
+            int id = contigs->find(resolution.substr(0, resolution.find('\t')));
+            ok = id >= 0 && contigs->resolution(id) == resolution;
+            ids[it->first] = id;
+        }
+        if (ok) {
+            parser->variantDB.remapChroms(ids);
+            parser->addChunk(VariantStore(), std::set<std::string>(ignored.begin(), ignored.end()));
+            futimens(fd, NULL); // the most recently used is evicted last
+        }
+        else {
+            parser->variantDB = VariantStore();
+        }
+        close(fd);
+        return ok;
+    }
+
+    // write the variants of filename, parsed into parser, replacing any entry atomically
+    bool save(const std::string &filename, const VCFParser &parser) const {
+        Key key;
+        if (!makeKey(filename, &key))
+            return false;
+        std::string name = entryName(key);
+        char suffix[32];
+        static std::atomic<unsigned int> saveCount(0);
+        snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", (int)getpid(), saveCount++);
+        std::string tmpName = name + suffix;
+        FILE *out = fopen(tmpName.c_str(), "wb");
+        if (out == NULL) {
+            if (!writeFailed.exchange(true))
+                printf("Error - unable to write to cache directory %s: %s\n", directory.c_str(), strerror(errno));
+            return false;
+        }
+        const std::set<std::string> &ignored = parser.getIgnoredChrom();
+        std::vector<std::string> resolutions;
+        for (VariantStore::const_iterator it = parser.variantDB.begin(); it != parser.variantDB.end(); ++it)
+            resolutions.push_back(contigs->resolution(it->first));
+        bool ok = fwrite(&key, sizeof(key), 1, out) == 1 && writeNames(out, std::vector<std::string>(ignored.begin(), ignored.end()))
+            && writeNames(out, resolutions) && parser.variantDB.write(out);
+        ok = (fclose(out) == 0) && ok;
+        if (ok)
+            ok = rename(tmpName.c_str(), name.c_str()) == 0;
+        if (!ok) {
+            if (!writeFailed.exchange(true))
+                printf("Error - unable to write to cache directory %s: %s\n", directory.c_str(), strerror(errno));
+            unlink(tmpName.c_str());
+        }
+        return ok;
+    }
+
+    // remove the least recently used entries until those left take at most the cache size
+    void evict() const {
+        DIR *dir = opendir(directory.c_str());
+        if (dir == NULL)
+            return;
+        std::vector<std::pair<int64_t, std::pair<std::string, uint64_t> > > entries; // by last use
+        uint64_t total = 0;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            size_t len = strlen(entry->d_name);
+            struct stat st;
+            std::string path = directory + "/" + entry->d_name;
+            if (len < 5 || strcmp(entry->d_name + len - 5, ".gmvc") != 0 || stat(path.c_str(), &st) != 0)
+                continue;
+            int64_t lastUse = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+            entries.push_back(std::make_pair(lastUse, std::make_pair(path, (uint64_t)st.st_size)));
+            total += st.st_size;
+        }
+        closedir(dir);
+        std::sort(entries.begin(), entries.end());
+        for (size_t i=0; i<entries.size() && total > maxBytes; ++i) {
+            if (unlink(entries[i].second.first.c_str()) == 0)
+                total -= entries[i].second.second;
+        }
+    }
+};
+
+#define VCF_MIN_CHUNK_SIZE (1024*1024)
+
+// Parses VCF files on a thread pool. Each file is split into chunks of whole lines, which are
+// parsed and normalised into separate stores and then added to the parser of the file in order.
+class VCFFileParser {
+protected:
+    struct Chunk {
+        unsigned int file;
+        const char *begin;
+        const char *end;
+        VariantStore store;
+        std::set<std::string> ignoredChrom;
+        double parseSeconds;
+        double normalizeSeconds;
+    };
+
+    int compareType;
+    ParseRefFA *parseRefFA;
+    const RegionSet *regions;
+    const VariantCache *cache;
+    Profile *profile;
+    std::vector<VCFParser *> parsers;
+    std::vector<VCFBuffer *> buffers;
+    std::vector<Chunk *> chunks;
+    unsigned int failed;
+
+public:
+    VCFFileParser(const int compareType, ParseRefFA *parseRefFA, const RegionSet *regions = NULL) : compareType(compareType), parseRefFA(parseRefFA), regions(regions), cache(NULL), profile(NULL), failed(0) {}
+
+    // read the variants of VCFs from and write them to cache
+    void setCache(const VariantCache *variantCache) {
+        cache = variantCache;
+    }
+
+    // add the parse and normalisation time and variants of each file to profile
+    void setProfile(Profile *fileProfile) {
+        profile = fileProfile;
+    }
+
+    ~VCFFileParser() {
+        for (unsigned int i=0; i<buffers.size(); ++i)
+            delete buffers[i];
+        for (unsigned int i=0; i<chunks.size(); ++i)
+            delete chunks[i];
+    }
+
+    void operator()(unsigned int i) {
+        Chunk *chunk = chunks[i];
+        if (profile == NULL) {
+            parsers[chunk->file]->parseChunk(compareType, chunk->begin, chunk->end, parseRefFA, regions, chunk->store, chunk->ignoredChrom);
+            return;
+        }
+        double start = wallSeconds();
+        parsers[chunk->file]->parseChunk(compareType, chunk->begin, chunk->end, parseRefFA, regions, chunk->store, chunk->ignoredChrom, &chunk->normalizeSeconds);
+        chunk->parseSeconds = wallSeconds() - start;
+    }
+
+    // parse filenames[i] into *parsers[i]
+    bool parse(const std::vector<std::string> &filenames, const std::vector<VCFParser *> &fileParsers, unsigned int numThreads) {
+        parsers = fileParsers;
+        std::vector<bool> cached(filenames.size(), false);
+        for (unsigned int i=0; i<filenames.size(); ++i) {
+            if (cache != NULL && cache->load(filenames[i], parsers[i])) {
+                cached[i] = true;
+                continue;
+            }
+            VCFBuffer *buffer = new VCFBuffer();
+            buffers.push_back(buffer);
+            if (!buffer->open(filenames[i], numThreads, regions)) {
+                printf("Unable to open input file: %s [%s]\n", filenames[i].c_str(), strerror(errno));
+                failed = i;
+                return false;
+            }
+            uint64_t size = buffer->size();
+            uint64_t chunkSize = size / (4*numThreads) + 1;
+            if (chunkSize < VCF_MIN_CHUNK_SIZE)
+                chunkSize = VCF_MIN_CHUNK_SIZE;
+            const char *data = buffer->data();
+            const char *end = data + size;
+            for (const char *begin = data; begin < end; ) {
+                const char *chunkEnd = end;
+                if ((uint64_t)(end - begin) > chunkSize) {
+                    const char *eol = (const char *)memchr(begin + chunkSize, '\n', end - begin - chunkSize);
+                    if (eol != NULL)
+                        chunkEnd = eol+1;
+                }
+                Chunk *chunk = new Chunk();
+                chunk->file = i;
+                chunk->begin = begin;
+                chunk->end = chunkEnd;
+                chunk->parseSeconds = 0;
+                chunk->normalizeSeconds = 0;
+                chunks.push_back(chunk);
+                begin = chunkEnd;
+            }
+        }
+        double start = wallSeconds();
+        parallelFor(chunks.size(), numThreads, *this);
+        double parseWall = wallSeconds() - start;
+        double parseSeconds = 0, normalizeSeconds = 0;
+        std::vector<Profile::FileStats> stats(filenames.size());
+        for (unsigned int i=0; i<chunks.size(); ++i) {
+            parsers[chunks[i]->file]->addChunk(chunks[i]->store, chunks[i]->ignoredChrom);
+            stats[chunks[i]->file].parseSeconds += chunks[i]->parseSeconds;
+            stats[chunks[i]->file].normalizeSeconds += chunks[i]->normalizeSeconds;
+            parseSeconds += chunks[i]->parseSeconds;
+            normalizeSeconds += chunks[i]->normalizeSeconds;
+            delete chunks[i];
+        }
+        chunks.clear();
+        for (unsigned int i=0; i<buffers.size(); ++i)
+            delete buffers[i];
+        buffers.clear();
+        for (unsigned int i=0; i<parsers.size(); ++i) {
+            if (cached[i])
+                continue;
+            parsers[i]->variantDB.finish(numThreads);
+            if (cache != NULL)
+                cache->save(filenames[i], *parsers[i]);
+        }
+        if (cache != NULL)
+            cache->evict();
+        if (profile != NULL) {
+            // normalising is interleaved with parsing, so its wall time is that of the parallel
+            // parse in proportion to the thread time spent normalising
+            profile->add("normalize_wall_seconds", parseSeconds > 0 ? parseWall * normalizeSeconds / parseSeconds : 0.0);
+            for (unsigned int i=0; i<filenames.size(); ++i) {
+                stats[i].name = filenames[i];
+                stats[i].cached = cached[i];
+                stats[i].variants = parsers[i]->size();
+                stats[i].storeBytes = parsers[i]->variantDB.bytes();
+                stats[i].ignoredChrom = parsers[i]->getIgnoredChrom();
+                profile->addFile(stats[i]);
+            }
+        }
+        return true;
+    }
+
+    // index of the file that could not be parsed
+    unsigned int failedFile() const {
+        return failed;
+    }
+};
+
+bool VCFParser::parseFile(const int compareType, const std::string &filename, ParseRefFA *parseRefFA, unsigned int numThreads) {
+    VCFFileParser fileParser(compareType, parseRefFA);
+    return fileParser.parse(std::vector<std::string>(1, filename), std::vector<VCFParser *>(1, this), numThreads);
+}
+
+#define VCF_FORMAT_FIELD 8 // index of the FORMAT field, followed by the sample columns
+
+// Reads the sample columns of a multi-sample VCF in one parse, into a VCFParser per sample holding
+// the alleles its GT carries, scored by its GQ or else by QUAL. With sites, the first VCFParser
+// holds every allele scored by QUAL, as VCFParser::parseFile would.
+class MultiSampleVCF {
+protected:
+    const ContigDictionary *contigs;
+    bool withSites;
+    int compareType;
+    ParseRefFA *parseRefFA;
+    const RegionSet *regions;
+
+    // a normalised ALT allele of the line being parsed
+    struct Allele {
+        uint64_t pos;
+        unsigned int srcLen;
+        std::string dst;
+        bool used; // of the type compared
+    };
+
+    struct Chunk {
+        const char *begin;
+        const char *end;
+        std::vector<VariantStore> stores;
+        std::set<std::string> ignoredChrom;
+    };
+    std::vector<Chunk *> chunks;
+
+    // parses the line at begin into stores, one per sample after the sites if any, and returns the
+    // start of the next line
+    const char *parseLine(const char *begin, const char *end, ContigLookup &lookup, VariantNormalizer &normalizer, std::vector<VariantStore> &stores,
+                          std::vector<const char *> &field, std::vector<const char *> &fieldEnd, std::vector<Allele> &alleles, std::set<std::string> &ignored) const {
+        unsigned int numSamples = names.size();
+        const char *next;
+        unsigned int numFields = tokenizeVCFLine(begin, end, VCF_FORMAT_FIELD + 1 + numSamples, &field[0], &fieldEnd[0], &next);
+        if (numFields < VCF_NUM_FIELDS)
+            return next;
+        int chromId = lookup.find(field[0], fieldEnd[0] - field[0]);
+        if (chromId < 0) {
+            ignored.insert(std::string(field[0], fieldEnd[0]));
+            return next;
+        }
+        uint64_t pos = parseVCFPos(field[1], fieldEnd[1]);
+        const char *ref = field[3];
+        unsigned int refLen = fieldEnd[3] - ref;
+        if (regions != NULL && !regions->overlaps(chromId, pos-1, pos-1+refLen))
+            return next;
+        double qual = parseVCFQual(field[5], fieldEnd[5]);
+
+        // every ALT is normalised once, alleles[k] being ALT k+1, empty ones skipped as parseLine does
+        alleles.clear();
+        for (const char *alt = field[4]; alt < fieldEnd[4]; ) {
+            const char *altEnd = (const char *)memchr(alt, ',', fieldEnd[4] - alt);
+            if (altEnd == NULL)
+                altEnd = fieldEnd[4];
+            if (altEnd > alt) {
+                normalizer.normalize(chromId, pos, ref, refLen, alt, altEnd - alt);
+                Allele allele;
+                allele.pos = normalizer.pos;
+                allele.srcLen = normalizer.srcLen;
+                allele.dst.assign(normalizer.dst, normalizer.dstLen);
+                bool isSNP = (normalizer.srcLen == 1 && normalizer.dstLen == 1);
+                allele.used = !(compareType == COMPARE_SNP && !isSNP) && !(compareType == COMPARE_INDEL && isSNP);
+                alleles.push_back(allele);
+            }
+            alt = altEnd + 1;
+        }
+        unsigned int offset = 0;
+        if (withSites) {
+            for (size_t k=0; k<alleles.size(); ++k) {
+                if (alleles[k].used)
+                    stores[0].add(chromId, alleles[k].pos, alleles[k].srcLen, alleles[k].dst.data(), alleles[k].dst.size(), qual);
+            }
+            offset = 1;
+        }
+        if (numFields <= VCF_FORMAT_FIELD)
+            return next;
+
+        // subfields of GT and GQ in FORMAT
+        int gtIndex = -1, gqIndex = -1, index = 0;
+        for (const char *key = field[VCF_FORMAT_FIELD]; key < fieldEnd[VCF_FORMAT_FIELD]; ++index) {
+            const char *keyEnd = (const char *)memchr(key, ':', fieldEnd[VCF_FORMAT_FIELD] - key);
+            if (keyEnd == NULL)
+                keyEnd = fieldEnd[VCF_FORMAT_FIELD];
+            if (keyEnd - key == 2 && key[0] == 'G' && key[1] == 'T')
+                gtIndex = index;
+            else if (keyEnd - key == 2 && key[0] == 'G' && key[1] == 'Q')
+                gqIndex = index;
+            key = keyEnd + 1;
+        }
+        if (gtIndex < 0)
+            return next;
+        for (unsigned int i=0; i+VCF_FORMAT_FIELD+1 < numFields; ++i) {
+            const char *gt = NULL, *gtEnd = NULL, *gq = NULL, *gqEnd = NULL;
+            const char *sub = field[VCF_FORMAT_FIELD+1+i], *subsEnd = fieldEnd[VCF_FORMAT_FIELD+1+i];
+            for (index = 0; sub <= subsEnd && (gt == NULL || (gqIndex >= 0 && gq == NULL)); ++index) {
+                const char *subEnd = (const char *)memchr(sub, ':', subsEnd - sub);
+                if (subEnd == NULL)
+                    subEnd = subsEnd;
+                if (index == gtIndex) {
+                    gt = sub;
+                    gtEnd = subEnd;
+                }
+                else if (index == gqIndex) {
+                    gq = sub;
+                    gqEnd = subEnd;
+                }
+                sub = subEnd + 1;
+            }
+            if (gt == NULL)
+                continue;
+            double score = (gq != NULL && gq < gqEnd && *gq != '.') ? parseVCFQual(gq, gqEnd) : qual;
+            // each allele of GT once, e.g. 0/1, 1|1, 1/2 or 1
+            unsigned int added = 0; // alleles added, as bits of ALTs up to 32
+            for (const char *p = gt; p < gtEnd; ) {
+                if (*p < '0' || *p > '9') {
+                    ++p;
+                    continue;
+                }
+                unsigned int allele = 0;
+                for (; p < gtEnd && *p >= '0' && *p <= '9'; ++p)
+                    allele = allele*10 + (*p - '0');
+                if (allele == 0 || allele > alleles.size() || !alleles[allele-1].used)
+                    continue;
+                if (allele <= 32) {
+                    if (added & (1u << (allele-1)))
+                        continue;
+                    added |= 1u << (allele-1);
+                }
+                const Allele &a = alleles[allele-1];
+                stores[offset+i].add(chromId, a.pos, a.srcLen, a.dst.data(), a.dst.size(), score);
+            }
+        }
+        return next;
+    }
+
+public:
+    std::vector<std::string> names; // of the sample columns
+
+    MultiSampleVCF(const ContigDictionary *contigs, bool withSites, const int compareType, ParseRefFA *parseRefFA, const RegionSet *regions = NULL)
+        : contigs(contigs), withSites(withSites), compareType(compareType), parseRefFA(parseRefFA), regions(regions) {}
+
+    ~MultiSampleVCF() {
+        for (size_t i=0; i<chunks.size(); ++i)
+            delete chunks[i];
+    }
+
+    // the sample names of the #CHROM line of filename, false if it cannot be read
+    bool readHeader(const std::string &filename) {
+        gzFile in = gzopen(filename.c_str(), "rb");
+        if (in == NULL)
+            return false;
+        names.clear();
+        std::string line;
+        char buf[65536];
+        while (gzgets(in, buf, sizeof(buf)) != NULL) {
+            line += buf;
+            if (line.empty() || line[line.size()-1] != '\n')
+                continue; // longer than buf
+            if (line[0] != '#')
+                break;
+            if (line.compare(0, 6, "#CHROM") == 0) {
+                line.erase(line.find_last_not_of("\r\n") + 1);
+                size_t start = 0;
+                for (unsigned int i=0; start != std::string::npos; ++i) {
+                    size_t tab = line.find('\t', start);
+                    if (i > VCF_FORMAT_FIELD)
+                        names.push_back(line.substr(start, (tab == std::string::npos) ? tab : tab - start));
+                    start = (tab == std::string::npos) ? tab : tab + 1;
+                }
+                break;
+            }
+            line.clear();
+        }
+        gzclose(in);
+        return true;
+    }
+
+    void operator()(unsigned int i) {
+        Chunk *chunk = chunks[i];
+        ContigLookup lookup(contigs);
+        VariantNormalizer normalizer(parseRefFA, contigs);
+        std::vector<const char *> field(VCF_FORMAT_FIELD + 1 + names.size()), fieldEnd(field.size());
+        std::vector<Allele> alleles;
+        chunk->stores.resize(names.size() + withSites);
+        for (const char *begin = chunk->begin; begin < chunk->end; )
+            begin = parseLine(begin, chunk->end, lookup, normalizer, chunk->stores, field, fieldEnd, alleles, chunk->ignoredChrom);
+    }
+
+    // parse filename, after readHeader, into a new VCFParser per sample after the sites if any,
+    // in chunks on numThreads. False if it cannot be read
+    bool parse(const std::string &filename, unsigned int numThreads, std::vector<VCFParser *> *parsers) {
+        VCFBuffer buffer;
+        if (!buffer.open(filename, numThreads, regions))
+            return false;
+        uint64_t size = buffer.size();
+        uint64_t chunkSize = size / (4*numThreads) + 1;
+        if (chunkSize < VCF_MIN_CHUNK_SIZE)
+            chunkSize = VCF_MIN_CHUNK_SIZE;
+        const char *end = buffer.data() + size;
+        for (const char *begin = buffer.data(); begin < end; ) {
+            const char *chunkEnd = end;
+            if ((uint64_t)(end - begin) > chunkSize) {
+                const char *eol = (const char *)memchr(begin + chunkSize, '\n', end - begin - chunkSize);
+                if (eol != NULL)
+                    chunkEnd = eol+1;
+            }
+            Chunk *chunk = new Chunk();
+            chunk->begin = begin;
+            chunk->end = chunkEnd;
+            chunks.push_back(chunk);
+            begin = chunkEnd;
+        }
+        parallelFor(chunks.size(), numThreads, *this);
+        parsers->clear();
+        for (size_t i=0; i<names.size() + withSites; ++i)
+            parsers->push_back(new VCFParser(contigs));
+        for (size_t c=0; c<chunks.size(); ++c) {
+            for (size_t i=0; i<parsers->size(); ++i)
+                (*parsers)[i]->addChunk(chunks[c]->stores[i], chunks[c]->ignoredChrom);
+            delete chunks[c];
+        }
+        chunks.clear();
+        for (size_t i=0; i<parsers->size(); ++i)
+            (*parsers)[i]->variantDB.finish(numThreads);
+        return true;
+    }
+};
+
+#define NUM_VARIANT_CLASSES 4
+#define NUM_INDEL_LENGTH_BINS 6
+#define NUM_QUAL_BINS 6
+
+// True positives, false positives and false negatives of a stratum
+struct StratumCounts {
+    uint64_t truePositives;
+    uint64_t goldTruePositives; // the same as truePositives unless matched fuzzily
+    uint64_t falsePositives;
+    uint64_t falseNegatives;
+
+    StratumCounts() : truePositives(0), goldTruePositives(0), falsePositives(0), falseNegatives(0) {}
+};
+
+// Precision, recall and F-score of a sample by chromosome, variant class, indel length, QUAL and
+// BED regions, all counted in one pass over the gold set and the sample once matched. Every
+// variant is classified once into the strata it belongs to and counted in each. QUAL strata count
+// only sample variants, as gold set variants not called have no QUAL of the sample.
+class Stratifier {
+protected:
+    const ContigDictionary *contigs;
+    std::vector<std::string> bedNames;
+    std::vector<RegionSet *> beds;
+    std::vector<int> chroms; // chromosome ids with a stratum, in order
+    std::vector<std::string> strata; // "stratum\tvalue" of each stratum
+
+    enum {
+        STRATUM_ALL = 0,
+        STRATUM_CLASS = 1,
+        STRATUM_INDEL_LENGTH = STRATUM_CLASS + NUM_VARIANT_CLASSES,             // deletions, then insertions
+        STRATUM_QUAL = STRATUM_INDEL_LENGTH + 2*NUM_INDEL_LENGTH_BINS,
+        STRATUM_BED = STRATUM_QUAL + NUM_QUAL_BINS                              // then chromosomes
+    };
+
+    static unsigned int indelLengthBin(unsigned int len) {
+        static const unsigned int binEnd[NUM_INDEL_LENGTH_BINS-1] = { 1, 5, 10, 20, 50 };
+        unsigned int bin = 0;
+        while (bin < NUM_INDEL_LENGTH_BINS-1 && len > binEnd[bin])
+            bin++;
+        return bin;
+    }
+
+    static unsigned int qualBin(double qual) {
+        static const double binEnd[NUM_QUAL_BINS-1] = { 10, 20, 30, 50, 100 };
+        unsigned int bin = 0;
+        while (bin < NUM_QUAL_BINS-1 && qual >= binEnd[bin])
+            bin++;
+        return bin;
+    }
+
+    // the strata of a variant of chromosome stratum chromStratum, QUAL strata only if withQual
+    void classify(int chrom, unsigned int chromStratum, const VariantRecord &record, bool withQual, std::vector<unsigned int> *found) const {
+        found->clear();
+        found->push_back(STRATUM_ALL);
+        unsigned int variantClass;
+        if (record.srcLen == 1 && record.dstLen == 1)
+            variantClass = 0; // SNP, as in snp mode
+        else if (record.srcLen == 0 && record.dstLen > 0)
+            variantClass = 1; // insertion
+        else if (record.dstLen == 0 && record.srcLen > 0)
+            variantClass = 2; // deletion
+        else
+            variantClass = 3; // complex
+        found->push_back(STRATUM_CLASS + variantClass);
+        if (record.srcLen > record.dstLen)
+            found->push_back(STRATUM_INDEL_LENGTH + indelLengthBin(record.srcLen - record.dstLen));
+        else if (record.dstLen > record.srcLen)
+            found->push_back(STRATUM_INDEL_LENGTH + NUM_INDEL_LENGTH_BINS + indelLengthBin(record.dstLen - record.srcLen));
+        if (withQual)
+            found->push_back(STRATUM_QUAL + qualBin(record.qual));
+        for (size_t i=0; i<beds.size(); ++i) {
+            if (beds[i]->overlaps(chrom, record.pos-1, record.pos-1+record.srcLen))
+                found->push_back(STRATUM_BED + i);
+        }
+        found->push_back(chromStratum);
+    }
+
+    struct CountTask {
+        const Stratifier *stratifier;
+        const VariantStore *gold;
+        const VariantStore *sample;
+        const std::vector<bool> *goldMatched;
+        std::vector<VariantStore::const_iterator> goldChroms;   // gold.end() when not in gold
+        std::vector<uint64_t> goldBase;                         // index of first record of goldChroms
+        std::vector<VariantStore::const_iterator> sampleChroms; // sample.end() when not in sample
+        std::vector<std::vector<StratumCounts> > counts;        // by chromosome
+
+        void operator()(unsigned int i) {
+            std::vector<StratumCounts> &chromCounts = counts[i];
+            chromCounts.resize(stratifier->strata.size());
+            int chrom = stratifier->chroms[i];
+            unsigned int chromStratum = STRATUM_BED + stratifier->beds.size() + i;
+            std::vector<unsigned int> found;
+            if (sampleChroms[i] != sample->end()) {
+                const std::vector<VariantRecord> &records = sampleChroms[i]->second;
+                for (size_t j=0; j<records.size(); ++j) {
+                    stratifier->classify(chrom, chromStratum, records[j], true, &found);
+                    for (size_t k=0; k<found.size(); ++k) {
+                        if (records[j].isTruePositive)
+                            chromCounts[found[k]].truePositives++;
+                        else
+                            chromCounts[found[k]].falsePositives++;
+                    }
+                }
+            }
+            if (goldChroms[i] != gold->end()) {
+                const std::vector<VariantRecord> &records = goldChroms[i]->second;
+                for (size_t j=0; j<records.size(); ++j) {
+                    bool matched = (*goldMatched)[goldBase[i] + j];
+                    stratifier->classify(chrom, chromStratum, records[j], false, &found);
+                    for (size_t k=0; k<found.size(); ++k) {
+                        if (matched)
+                            chromCounts[found[k]].goldTruePositives++;
+                        else
+                            chromCounts[found[k]].falseNegatives++;
+                    }
+                }
+            }
+        }
+    };
+
+public:
+    Stratifier(const ContigDictionary *contigs) : contigs(contigs) {}
+
+    ~Stratifier() {
+        for (size_t i=0; i<beds.size(); ++i)
+            delete beds[i];
+    }
+
+    // add the regions of a BED file as stratum name
+    bool addBed(const std::string &name, const std::string &filename) {
+        RegionSet *bed = new RegionSet();
+        if (!bed->read(filename)) {
+            delete bed;
+            return false;
+        }
+        bed->index(*contigs);
+        bedNames.push_back(name);
+        beds.push_back(bed);
+        return true;
+    }
+
+    // count the strata of a sample matched against gold, where goldMatched holds the gold
+    // variants found (see VariantStore::match). Counts are by stratum, in order of names().
+    void count(const VariantStore &gold, const VariantStore &sample, const std::vector<bool> &goldMatched, unsigned int numThreads, std::vector<StratumCounts> *counts) {
+        static const char *classNames[NUM_VARIANT_CLASSES] = { "SNP", "insertion", "deletion", "complex" };
+        static const char *lengthNames[NUM_INDEL_LENGTH_BINS] = { "1", "2-5", "6-10", "11-20", "21-50", "51+" };
+        static const char *qualNames[NUM_QUAL_BINS] = { "0-10", "10-20", "20-30", "30-50", "50-100", "100+" };
+
+        std::set<int> chromSet;
+        for (VariantStore::const_iterator it = gold.begin(); it != gold.end(); ++it)
+            chromSet.insert(it->first);
+        for (VariantStore::const_iterator it = sample.begin(); it != sample.end(); ++it)
+            chromSet.insert(it->first);
+        chroms.assign(chromSet.begin(), chromSet.end());
+
+        strata.clear();
+        strata.push_back("all\tall");
+        for (unsigned int i=0; i<NUM_VARIANT_CLASSES; ++i)
+            strata.push_back(std::string("class\t") + classNames[i]);
+        for (unsigned int i=0; i<NUM_INDEL_LENGTH_BINS; ++i)
+            strata.push_back(std::string("deletion_length\t") + lengthNames[i]);
+        for (unsigned int i=0; i<NUM_INDEL_LENGTH_BINS; ++i)
+            strata.push_back(std::string("insertion_length\t") + lengthNames[i]);
+        for (unsigned int i=0; i<NUM_QUAL_BINS; ++i)
+            strata.push_back(std::string("qual\t") + qualNames[i]);
+        for (size_t i=0; i<bedNames.size(); ++i)
+            strata.push_back("region\t" + bedNames[i]);
+        for (size_t i=0; i<chroms.size(); ++i)
+            strata.push_back("chrom\t" + contigs->name(chroms[i]));
+
+        CountTask task;
+        task.stratifier = this;
+        task.gold = &gold;
+        task.sample = &sample;
+        task.goldMatched = &goldMatched;
+        task.counts.resize(chroms.size());
+        VariantStore::const_iterator goldIt = gold.begin(), sampleIt = sample.begin();
+        uint64_t goldBase = 0;
+        for (size_t i=0; i<chroms.size(); ++i) {
+            if (goldIt != gold.end() && goldIt->first == chroms[i]) {
+                task.goldChroms.push_back(goldIt);
+                task.goldBase.push_back(goldBase);
+                goldBase += goldIt->second.size();
+                ++goldIt;
+            }
+            else {
+                task.goldChroms.push_back(gold.end());
+                task.goldBase.push_back(goldBase);
+            }
+            if (sampleIt != sample.end() && sampleIt->first == chroms[i])
+                task.sampleChroms.push_back(sampleIt++);
+            else
+                task.sampleChroms.push_back(sample.end());
+        }
+        parallelFor(chroms.size(), numThreads, task);
+
+        counts->assign(strata.size(), StratumCounts());
+        for (size_t i=0; i<chroms.size(); ++i) {
+            for (size_t j=0; j<strata.size(); ++j) {
+                (*counts)[j].truePositives += task.counts[i][j].truePositives;
+                (*counts)[j].goldTruePositives += task.counts[i][j].goldTruePositives;
+                (*counts)[j].falsePositives += task.counts[i][j].falsePositives;
+                (*counts)[j].falseNegatives += task.counts[i][j].falseNegatives;
+            }
+        }
+    }
+
+    // write a line per stratum with counts from count(), a metric without variants to derive it from is "."
+    void write(FILE *out, const char *name, const std::vector<StratumCounts> &counts) const {
+        for (size_t i=0; i<strata.size(); ++i) {
+            const StratumCounts &c = counts[i];
+            bool isQual = (i >= STRATUM_QUAL && i < STRATUM_BED);
+            fprintf(out, "%s\t%s\t%" PRIu64 "\t%" PRIu64 "\t", name, strata[i].c_str(), c.truePositives, c.falsePositives);
+            if (isQual)
+                fprintf(out, ".\t");
+            else
+                fprintf(out, "%" PRIu64 "\t", c.falseNegatives);
+            if (c.truePositives + c.falsePositives > 0)
+                fprintf(out, "%lf\t", (double)c.truePositives / (double)(c.truePositives + c.falsePositives));
+            else
+                fprintf(out, ".\t");
+            if (!isQual && c.goldTruePositives + c.falseNegatives > 0) {
+                fprintf(out, "%lf\t", (double)c.goldTruePositives / (double)(c.goldTruePositives + c.falseNegatives));
+                fprintf(out, "%lf\n", (double)(c.truePositives + c.goldTruePositives) / (double)(c.truePositives + c.goldTruePositives + c.falsePositives + c.falseNegatives));
+            }
+            else {
+                fprintf(out, ".\t.\n");
+            }
+        }
+    }
+};
+
+// writes the precision-recall curve of each sample, named by its file
+bool writePRFile(const char *filename, const std::vector<ROCCurve> &curves, const std::vector<std::string> &names, const std::vector<uint64_t> &trueSetSizes) {
+    FILE *out = fopen(filename, "w");
+    if (out == NULL) {
+        printf("Error writing file %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    fprintf(out, "#sample\tqual\tprecision\trecall\tfscore\n");
+    for (size_t i=0; i<curves.size(); ++i)
+        curves[i].writePR(out, names[i].c_str(), trueSetSizes[i]);
+    fclose(out);
+    return true;
+}
+
+// finds the true positives of each sample in the gold set, the samples in parallel
+struct MatchTask {
+    const VCFParser *goldSet;
+    std::vector<const VCFParser *> goldSets; // of each sample in place of goldSet, if not empty
+    const FuzzyMatcher *fuzzy;
+    std::vector<VCFParser *> sampleSets;
+    std::vector<std::vector<bool> > positiveVariants;
+
+    void operator()(unsigned int i) {
+        const VCFParser *gold = goldSets.empty() ? goldSet : goldSets[i];
+        positiveVariants[i].resize(gold->size());
+        sampleSets[i]->matchTruePositives(*gold, &positiveVariants[i], fuzzy);
+    }
+};
+
+// builds the ROC curve of each matched sample, the samples in parallel
+struct CurveTask {
+    std::vector<VCFParser *> sampleSets;
+    std::vector<ROCCurve> curves;
+
+    void operator()(unsigned int i) {
+        std::vector<ScoredVariant> scored;
+        sampleSets[i]->getScoredVariants(&scored);
+        curves[i].build(scored);
+    }
+};
+
+// Outputs and threads of an evaluation besides the metrics printed
+struct ReportOptions {
+    unsigned int numThreads;
+    const char *prFile;     // precision-recall curves, or NULL
+    Stratifier *stratifier; // stratified metrics written to strataOut, or NULL
+    FILE *strataOut;
+    const FuzzyMatcher *fuzzy; // to match after exact matching, or NULL
+    Profile *profile;          // to time the match, roc and strata phases, or NULL
+    unsigned int rocPoints;    // false positive rates of the ROC plot, evenly spaced, or 0 for every false positive count
+    bool rocJSON;              // print the ROC metrics and plot as JSON rather than text
+    const char *rocBinary;     // file for the ROC plot as float arrays rather than printing it, or NULL
+    unsigned int bootstrapReplicates; // to print confidence intervals of the metrics, or 0
+    uint64_t bootstrapBlock;   // bases of the blocks resampled
+    bool prMetrics;            // print the AUC_PR and best F-score lines after the ROC metrics
+};
+
+// Counts and ROC curves of samples matched against the gold set, by sample
+struct SampleResults {
+    std::vector<uint64_t> sizes;
+    std::vector<uint64_t> truePositives;
+    std::vector<uint64_t> goldTruePositives; // the same as truePositives unless matched fuzzily
+    std::vector<ROCCurve> curves; // built only when needed for a single sample
+    uint64_t numUnionPositives;   // gold set variants found by any sample
+    std::vector<uint64_t> trueSetSizes;   // of the truth set of each sample, empty when all share the gold set
+    std::vector<uint64_t> unionPositives; // numUnionPositives of the samples sharing each sample's truth set, likewise
+};
+
+// True positive rates of the ROC plots of samples, as returned by ROCCurve::auc, linearly
+// interpolated at any number of false positives
+class ROCPlotter {
+protected:
+    const std::vector<std::vector<std::pair<uint64_t, uint64_t> > > &plots;
+    std::vector<uint64_t> numPositives; // by which the true positives of each sample are normalised
+    std::vector<size_t> plotPos;
+
+public:
+    ROCPlotter(const std::vector<std::vector<std::pair<uint64_t, uint64_t> > > &plots, const std::vector<uint64_t> &numPositives)
+        : plots(plots), numPositives(numPositives), plotPos(plots.size(), 0) {}
+
+    unsigned int numSamples() const {
+        return plots.size();
+    }
+
+    // start again from no false positives
+    void rewind() {
+        std::fill(plotPos.begin(), plotPos.end(), 0);
+    }
+
+    // rate of sample i at falsePositives, which must not decrease between calls for the sample
+    double truePositiveRate(unsigned int i, double falsePositives) {
+        const std::vector<std::pair<uint64_t, uint64_t> > &plot = plots[i];
+        while (plot[plotPos[i]].first < falsePositives)
+            plotPos[i]++;
+        double foundFalsePos = plot[plotPos[i]].first;
+        double foundTruePos = plot[plotPos[i]].second;
+        if (foundFalsePos == falsePositives)
+            return foundTruePos / numPositives[i];
+        // interpolate with previous data entry
+        double prevFoundFalsePos = plot[plotPos[i]-1].first;
+        double prevFoundTruePos = plot[plotPos[i]-1].second;
+        double interp = (falsePositives - prevFoundFalsePos) / (foundFalsePos - prevFoundFalsePos);
+        double interpTruePos = interp * foundTruePos + (1.0-interp) * prevFoundTruePos;
+        return interpTruePos / numPositives[i];
+    }
+};
+
+// writes n as a JSON number, null if not finite
+void writeJSONNumber(FILE *out, double n) {
+    if (isfinite(n))
+        fprintf(out, "%.9g", n);
+    else
+        fprintf(out, "null");
+}
+
+// writes the ROC plot to filename as float32 arrays in host byte order: the number of points and
+// of samples as uint32, the false positive rates, then the true positive rates of each sample
+bool writeROCBinary(const char *filename, const std::vector<double> &plotFalsePositives, uint64_t maxFalsePositives, ROCPlotter &plotter) {
+    FILE *out = fopen(filename, "wb");
+    if (out == NULL) {
+        printf("Error writing file %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    uint32_t numPoints = plotFalsePositives.size(), numSamples = plotter.numSamples();
+    std::vector<float> values(numPoints);
+    bool ok = fwrite(&numPoints, sizeof(numPoints), 1, out) == 1 && fwrite(&numSamples, sizeof(numSamples), 1, out) == 1;
+    for (uint32_t j=0; j<numPoints; ++j)
+        values[j] = plotFalsePositives[j] / (double)maxFalsePositives;
+    ok = ok && (numPoints == 0 || fwrite(&values[0], sizeof(float), numPoints, out) == numPoints);
+    for (uint32_t i=0; ok && i<numSamples; ++i) {
+        for (uint32_t j=0; j<numPoints; ++j)
+            values[j] = plotter.truePositiveRate(i, plotFalsePositives[j]);
+        ok = numPoints == 0 || fwrite(&values[0], sizeof(float), numPoints, out) == numPoints;
+    }
+    ok = (fclose(out) == 0) && ok;
+    if (!ok)
+        printf("Error writing file %s: %s\n", filename, strerror(errno));
+    return ok;
+}
+
+#define BOOTSTRAP_BLOCK_SIZE 1000000 // bases of the genomic blocks resampled by default
+#define BOOTSTRAP_METRICS 4           // AUC, precision, recall and F-score
+
+// Confidence intervals of the metrics of samples by block bootstrap: the genome is cut into blocks,
+// and each replicate draws as many blocks as there are, with replacement, and recomputes the
+// metrics from the variants of the blocks drawn. Variants are counted per block, and per block and
+// score for the ROC curves, once, so a replicate only sums counts. Replicate r draws with its own
+// generator seeded by r, so the intervals do not depend on the number of threads.
+class Bootstrap {
+protected:
+    // variants of a sample with one score in one block
+    struct Bin {
+        uint32_t score; // index into the sample's scores
+        uint32_t truePositives;
+        uint32_t falsePositives;
+    };
+
+    uint64_t blockSize;
+    unsigned int numSamples;
+    unsigned int numBlocks;
+    std::vector<uint64_t> goldCounts;                  // gold set variants by block
+    std::vector<uint64_t> unionCounts;                 // gold set variants found by any sample, by block
+    std::vector<std::vector<uint64_t> > goldFound;     // gold set variants found, by sample and block
+    std::vector<std::vector<double> > scores;          // distinct scores of each sample, highest first
+    std::vector<std::vector<std::vector<Bin> > > bins; // by sample and block
+    std::vector<std::vector<double> > values;          // metrics of each replicate, by replicate and sample
+
+    struct BlockIndex {
+        std::map<std::pair<int, uint64_t>, unsigned int> ids;
+        uint64_t blockSize;
+
+        unsigned int operator()(int chrom, uint64_t pos) {
+            std::pair<std::map<std::pair<int, uint64_t>, unsigned int>::iterator, bool> it =
+                ids.insert(std::make_pair(std::make_pair(chrom, pos / blockSize), (unsigned int)ids.size()));
+            return it.first->second;
+        }
+    };
+
+    struct ScoreAfter {
+        bool operator()(double a, double b) const {
+            return a > b;
+        }
+    };
+
+    // splitmix64
+    static uint64_t random(uint64_t *state) {
+        uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // metrics of replicate r into values[r]
+    void replicate(unsigned int r, std::vector<unsigned int> &weights, std::vector<uint64_t> &truePositives, std::vector<uint64_t> &falsePositives) {
+        uint64_t state = hash64(&r, sizeof(r), 0x626f6f74);
+        std::fill(weights.begin(), weights.end(), 0);
+        for (unsigned int b=0; b<numBlocks; ++b)
+            weights[random(&state) % numBlocks]++;
+        uint64_t trueSetSize = 0, numUnionPositives = 0;
+        for (unsigned int b=0; b<numBlocks; ++b) {
+            trueSetSize += weights[b] * goldCounts[b];
+            numUnionPositives += weights[b] * unionCounts[b];
+        }
+        std::vector<ROCCurve> curves(numSamples);
+        std::vector<double> &metrics = values[r];
+        uint64_t maxFalsePositives = 0;
+        for (unsigned int i=0; i<numSamples; ++i) {
+            truePositives.assign(scores[i].size(), 0);
+            falsePositives.assign(scores[i].size(), 0);
+            uint64_t numGoldFound = 0;
+            for (unsigned int b=0; b<numBlocks; ++b) {
+                if (weights[b] == 0)
+                    continue;
+                numGoldFound += weights[b] * goldFound[i][b];
+                const std::vector<Bin> &blockBins = bins[i][b];
+                for (size_t k=0; k<blockBins.size(); ++k) {
+                    truePositives[blockBins[k].score] += weights[b] * blockBins[k].truePositives;
+                    falsePositives[blockBins[k].score] += weights[b] * blockBins[k].falsePositives;
+                }
+            }
+            ROCCurve::Point point;
+            point.truePositives = 0;
+            point.falsePositives = 0;
+            for (size_t k=0; k<scores[i].size(); ++k) {
+                if (truePositives[k] == 0 && falsePositives[k] == 0)
+                    continue;
+                point.score = scores[i][k];
+                point.truePositives += truePositives[k];
+                point.falsePositives += falsePositives[k];
+                curves[i].points.push_back(point);
+            }
+            if (point.falsePositives > maxFalsePositives)
+                maxFalsePositives = point.falsePositives;
+            // as printSample and printROC
+            double *m = &metrics[i*BOOTSTRAP_METRICS];
+            uint64_t numFalseNegatives = trueSetSize - numGoldFound;
+            m[1] = (double)point.truePositives / (double)(point.truePositives + point.falsePositives);
+            m[2] = (double)numGoldFound / (double)trueSetSize;
+            m[3] = (double)(point.truePositives+numGoldFound)/(double)(point.truePositives+numGoldFound+point.falsePositives+numFalseNegatives);
+        }
+        std::vector<std::pair<uint64_t, uint64_t> > plot;
+        for (unsigned int i=0; i<numSamples; ++i)
+            metrics[i*BOOTSTRAP_METRICS] = curves[i].auc(numUnionPositives, maxFalsePositives, &plot);
+    }
+
+    // the q quantile of v, which it sorts
+    static double percentile(std::vector<double> &v, double q) {
+        std::sort(v.begin(), v.end());
+        return v[(size_t)(q * (v.size() - 1) + 0.5)];
+    }
+
+public:
+    Bootstrap(uint64_t blockSize) : blockSize(blockSize), numSamples(0), numBlocks(0) {}
+
+    // count the variants of gold and the samples by block, goldMatched[i] being the gold set
+    // variants found by sample i
+    void count(const VariantStore &gold, const std::vector<const VariantStore *> &samples, const std::vector<const std::vector<bool> *> &goldMatched) {
+        BlockIndex blockIndex;
+        blockIndex.blockSize = blockSize;
+        numSamples = samples.size();
+        std::vector<unsigned int> goldBlocks;
+        goldBlocks.reserve(gold.size());
+        for (VariantStore::const_iterator it = gold.begin(); it != gold.end(); ++it) {
+            for (size_t j=0; j<it->second.size(); ++j)
+                goldBlocks.push_back(blockIndex(it->first, it->second[j].pos));
+        }
+        std::vector<std::vector<unsigned int> > sampleBlocks(numSamples);
+        for (unsigned int i=0; i<numSamples; ++i) {
+            for (VariantStore::const_iterator it = samples[i]->begin(); it != samples[i]->end(); ++it) {
+                for (size_t j=0; j<it->second.size(); ++j)
+                    sampleBlocks[i].push_back(blockIndex(it->first, it->second[j].pos));
+            }
+        }
+        numBlocks = blockIndex.ids.size();
+
+        goldCounts.assign(numBlocks, 0);
+        unionCounts.assign(numBlocks, 0);
+        goldFound.assign(numSamples, std::vector<uint64_t>(numBlocks, 0));
+        for (size_t j=0; j<goldBlocks.size(); ++j) {
+            goldCounts[goldBlocks[j]]++;
+            bool found = false;
+            for (unsigned int i=0; i<numSamples; ++i) {
+                if ((*goldMatched[i])[j]) {
+                    goldFound[i][goldBlocks[j]]++;
+                    found = true;
+                }
+            }
+            if (found)
+                unionCounts[goldBlocks[j]]++;
+        }
+
+        scores.assign(numSamples, std::vector<double>());
+        bins.assign(numSamples, std::vector<std::vector<Bin> >(numBlocks));
+        for (unsigned int i=0; i<numSamples; ++i) {
+            std::vector<double> &sampleScores = scores[i];
+            for (VariantStore::const_iterator it = samples[i]->begin(); it != samples[i]->end(); ++it) {
+                for (size_t j=0; j<it->second.size(); ++j)
+                    sampleScores.push_back(it->second[j].qual);
+            }
+            std::sort(sampleScores.begin(), sampleScores.end(), ScoreAfter());
+            sampleScores.erase(std::unique(sampleScores.begin(), sampleScores.end()), sampleScores.end());
+
+            // a bin per score present in each block
+            std::vector<std::map<uint32_t, Bin> > blockBins(numBlocks);
+            size_t k = 0;
+            for (VariantStore::const_iterator it = samples[i]->begin(); it != samples[i]->end(); ++it) {
+                for (size_t j=0; j<it->second.size(); ++j, ++k) {
+                    const VariantRecord &record = it->second[j];
+                    uint32_t score = std::lower_bound(sampleScores.begin(), sampleScores.end(), record.qual, ScoreAfter()) - sampleScores.begin();
+                    Bin &bin = blockBins[sampleBlocks[i][k]][score];
+                    bin.score = score;
+                    if (record.isTruePositive)
+                        bin.truePositives++;
+                    else
+                        bin.falsePositives++;
+                }
+            }
+            for (unsigned int b=0; b<numBlocks; ++b) {
+                for (std::map<uint32_t, Bin>::const_iterator it = blockBins[b].begin(); it != blockBins[b].end(); ++it)
+                    bins[i][b].push_back(it->second);
+            }
+        }
+    }
+
+    struct ReplicateTask {
+        Bootstrap *bootstrap;
+        unsigned int numReplicates;
+        unsigned int numThreads;
+
+        // replicates t, t+numThreads, ... with buffers of their own
+        void operator()(unsigned int t) {
+            std::vector<unsigned int> weights(bootstrap->numBlocks);
+            std::vector<uint64_t> truePositives, falsePositives;
+            for (unsigned int r=t; r<numReplicates; r += numThreads)
+                bootstrap->replicate(r, weights, truePositives, falsePositives);
+        }
+    };
+
+    // the metrics of numReplicates replicates
+    void run(unsigned int numReplicates, unsigned int numThreads) {
+        values.assign(numReplicates, std::vector<double>(numSamples * BOOTSTRAP_METRICS));
+        if (numBlocks == 0)
+            return;
+        ReplicateTask task;
+        task.bootstrap = this;
+        task.numReplicates = numReplicates;
+        task.numThreads = numThreads;
+        parallelFor(numThreads, numThreads, task);
+    }
+
+    // print the 95% percentile intervals of the metrics of each sample, AUC only with several
+    // samples, and of the differences between each pair of samples in the same replicates
+    void write(FILE *out, const std::vector<std::string> &names) {
+        bool withAUC = numSamples > 1;
+        std::vector<double> v(values.size());
+        fprintf(out, "BOOTSTRAP: replicates=%u blocks=%u block_size=%" PRIu64 "\n", (unsigned int)values.size(), numBlocks, blockSize);
+        if (values.empty() || numBlocks == 0)
+            return;
+        fprintf(out, "%s", withAUC ? "CI95[AUC/PREC/RECALL/FSCORE]:" : "CI95[PREC/RECALL/FSCORE]:");
+        for (unsigned int i=0; i<numSamples; ++i) {
+            fprintf(out, " %s=", names[i].c_str());
+            for (unsigned int m = withAUC ? 0 : 1; m<BOOTSTRAP_METRICS; ++m) {
+                for (size_t r=0; r<values.size(); ++r)
+                    v[r] = values[r][i*BOOTSTRAP_METRICS + m];
+                fprintf(out, "%s%lf-%lf", (m > (withAUC ? 0u : 1u)) ? "," : "", percentile(v, 0.025), percentile(v, 0.975));
+            }
+        }
+        fprintf(out, "\n");
+        if (numSamples < 2)
+            return;
+        // mean difference and its interval, first sample minus second
+        fprintf(out, "DIFF95[AUC/PREC/RECALL/FSCORE]:");
+        for (unsigned int i=0; i<numSamples; ++i) {
+            for (unsigned int j=i+1; j<numSamples; ++j) {
+                fprintf(out, " %s-%s=", names[i].c_str(), names[j].c_str());
+                for (unsigned int m=0; m<BOOTSTRAP_METRICS; ++m) {
+                    double sum = 0;
+                    for (size_t r=0; r<values.size(); ++r) {
+                        v[r] = values[r][i*BOOTSTRAP_METRICS + m] - values[r][j*BOOTSTRAP_METRICS + m];
+                        sum += v[r];
+                    }
+                    fprintf(out, "%s%lf(%lf,%lf)", m ? "," : "", sum / v.size(), percentile(v, 0.025), percentile(v, 0.975));
+                }
+            }
+        }
+        fprintf(out, "\n");
+    }
+};
+
+// prints precision, recall and F-score of the first sample of results, false if an output could not be written
+bool printSample(FILE *out, const ReportOptions &options, uint64_t trueSetSize, const SampleResults &results, const std::string &name) {
+    uint64_t sampleSetSize = results.sizes[0];
+
+    // items in sample that are in the gold set
+    uint64_t numTruePositives = results.truePositives[0];
+
+    // items in gold set that are in the sample
+    uint64_t numGoldTruePositives = results.goldTruePositives[0];
+
+    // items in sample that are not in the gold set
+    uint64_t numFalsePositives = sampleSetSize - numTruePositives;
+
+    // items in gold set that are not in the sample
+    uint64_t numFalseNegatives = trueSetSize - numGoldTruePositives;
+
+    fprintf(out, "Precision = %lf, Recall = %lf, F-score = %lf\n", (double)numTruePositives / (double)sampleSetSize, (double)numGoldTruePositives / (double)trueSetSize, (double)(numTruePositives+numGoldTruePositives)/(double)(numTruePositives+numGoldTruePositives+numFalsePositives+numFalseNegatives));
+    fprintf(out, "numTruePositives = %lf, sampleSetSize = %lf, trueSetSize = %lf\n", (double)numTruePositives, (double)sampleSetSize, (double)trueSetSize);
+    if (options.prFile != NULL && !writePRFile(options.prFile, results.curves, std::vector<std::string>(1, name), std::vector<uint64_t>(1, trueSetSize)))
+        return false;
+    return true;
+}
+
+// prints precision, recall, F-score and ROC AUC of each sample and the ROC plot of all, false if an output could not be written
+bool printROC(FILE *out, const ReportOptions &options, uint64_t trueSetSize, const SampleResults &results, const std::vector<std::string> &names) {
+    unsigned int numSamples = names.size();
+    uint64_t sampleSetSize[numSamples];
+    uint64_t numTruePositives[numSamples];
+    uint64_t numGoldTruePositives[numSamples];
+    uint64_t numFalsePositives[numSamples];
+    uint64_t numFalseNegatives[numSamples];
+    double fscore[numSamples];
+    std::vector<uint64_t> trueSetSizes(numSamples, trueSetSize);
+    std::vector<uint64_t> numPositives(numSamples, results.numUnionPositives);
+    for (unsigned int i=0; i<numSamples; ++i) {
+        if (!results.trueSetSizes.empty()) {
+            trueSetSizes[i] = results.trueSetSizes[i];
+            numPositives[i] = results.unionPositives[i];
+        }
+        sampleSetSize[i] = results.sizes[i];
+        // items in sample that are in the gold set
+        numTruePositives[i] = results.truePositives[i];
+        // items in gold set that are in the sample
+        numGoldTruePositives[i] = results.goldTruePositives[i];
+        // items in sample that are not in the gold set
+        numFalsePositives[i] = sampleSetSize[i] - numTruePositives[i];
+        // items in gold set that are not in the sample
+        numFalseNegatives[i] = trueSetSizes[i] - numGoldTruePositives[i];
+        fscore[i] = (double)(numTruePositives[i]+numGoldTruePositives[i])/(double)(numTruePositives[i]+numGoldTruePositives[i]+numFalsePositives[i]+numFalseNegatives[i]);
+    }
+/*
+    for (int i=0; i<numSamples; ++i)
+        fprintf(out, "%s ", names[i].c_str());
+    fprintf(out, "\n");
+*/
+    unsigned int numUnionPositiveVariants = results.numUnionPositives;
+    // false positive counts at which the plot is printed, every count of any sample unless downsampled
+    std::vector<double> plotFalsePositives;
+    uint64_t maxFalsePositives = 0;
+    if (options.rocPoints == 0) {
+        std::vector<uint64_t> allSortedPos(1, 0); // initial datapoint has no false positives
+        for (unsigned int i=0; i<numSamples; ++i) {
+            const std::vector<ROCCurve::Point> &points = results.curves[i].points;
+            for (size_t j=0; j<points.size(); ++j)
+                allSortedPos.push_back(points[j].falsePositives);
+        }
+        std::sort(allSortedPos.begin(), allSortedPos.end());
+        allSortedPos.erase(std::unique(allSortedPos.begin(), allSortedPos.end()), allSortedPos.end());
+        maxFalsePositives = allSortedPos.back();
+        plotFalsePositives.assign(allSortedPos.begin(), allSortedPos.end());
+    }
+    else {
+        for (unsigned int i=0; i<numSamples; ++i) {
+            const std::vector<ROCCurve::Point> &points = results.curves[i].points;
+            if (!points.empty() && points.back().falsePositives > maxFalsePositives)
+                maxFalsePositives = points.back().falsePositives;
+        }
+        for (unsigned int j=0; j<options.rocPoints; ++j)
+            plotFalsePositives.push_back((double)maxFalsePositives * j / (options.rocPoints - 1));
+    }
+
+    // interpolate from last given data point to (1.0,1.0) i.e. 100% true positive found at 100% false positive rate
+    std::vector<std::vector<std::pair<uint64_t, uint64_t> > > sortedSamples(numSamples);
+    double AUC[numSamples];
+    for (unsigned int i=0; i<numSamples; ++i)
+        AUC[i] = results.curves[i].auc(numPositives[i], maxFalsePositives, &sortedSamples[i]);
+    ROCPlotter plotter(sortedSamples, numPositives);
+
+    if (options.rocJSON) {
+        fprintf(out, "{\"true_set_size\":%" PRIu64 ",\"union_positives\":%u,\"max_false_positives\":%" PRIu64 ",\"fpr\":[", trueSetSize, numUnionPositiveVariants, maxFalsePositives);
+        for (size_t j=0; j<plotFalsePositives.size(); ++j) {
+            fprintf(out, "%s", j ? "," : "");
+            writeJSONNumber(out, plotFalsePositives[j] / (double)maxFalsePositives);
+        }
+        fprintf(out, "],\"samples\":[");
+        for (unsigned int i=0; i<numSamples; ++i) {
+            const ROCCurve &curve = results.curves[i];
+            fprintf(out, "%s{\"name\":", i ? "," : "");
+            writeJSONString(out, names[i]);
+            if (!results.trueSetSizes.empty())
+                fprintf(out, ",\"true_set_size\":%" PRIu64 ",\"union_positives\":%" PRIu64, trueSetSizes[i], numPositives[i]);
+            const char *keys[] = { "auc", "precision", "recall", "fscore", "auc_pr" };
+            double values[] = { AUC[i], (double)numTruePositives[i] / (double)sampleSetSize[i], (double)numGoldTruePositives[i] / (double)trueSetSizes[i], fscore[i], curve.aucPR(trueSetSizes[i]) };
+            for (unsigned int k=0; k<5; ++k) {
+                fprintf(out, ",\"%s\":", keys[k]);
+                writeJSONNumber(out, values[k]);
+            }
+            if (!curve.points.empty()) {
+                size_t best = curve.bestFScore(trueSetSizes[i]);
+                fprintf(out, ",\"best_fscore\":");
+                writeJSONNumber(out, curve.fscore(best, trueSetSizes[i]));
+                fprintf(out, ",\"best_fscore_qual\":");
+                writeJSONNumber(out, curve.points[best].score);
+            }
+            fprintf(out, ",\"tpr\":[");
+            plotter.rewind();
+            for (size_t j=0; j<plotFalsePositives.size(); ++j) {
+                fprintf(out, "%s", j ? "," : "");
+                writeJSONNumber(out, plotter.truePositiveRate(i, plotFalsePositives[j]));
+            }
+            fprintf(out, "]}");
+        }
+        fprintf(out, "]}\n");
+        if (options.prFile != NULL && !writePRFile(options.prFile, results.curves, names, trueSetSizes))
+            return false;
+        return true;
+    }
+    // print AUC along with filename
+    fprintf(out, "NAMED_AUC:");
+    for (int i=0; i<numSamples; ++i) {
+        fprintf(out, " %s=%lf", names[i].c_str(),AUC[i]);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "AUC:");
+    for (int i=0; i<numSamples; ++i) {
+        fprintf(out, " %lf", AUC[i]);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "PREC:");
+    for (int i=0; i<numSamples; ++i) {
+        fprintf(out, " %lf", (double)numTruePositives[i] / (double)sampleSetSize[i]);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "RECALL:");
+    for (int i=0; i<numSamples; ++i) {
+        fprintf(out, " %lf", (double)numGoldTruePositives[i] / (double)trueSetSizes[i]);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "FSCORE:");
+    for (int i=0; i<numSamples; ++i) {
+        fprintf(out, " %lf", fscore[i]);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "CSV[AUC/PREC/RECALL/FSCORE]:");
+    for (int i=0; i<numSamples; ++i) {
+        fprintf(out, " %s=%lf,%lf,%lf,%lf", names[i].c_str(), AUC[i],(double)numTruePositives[i] / (double)sampleSetSize[i], (double)numGoldTruePositives[i] / (double)trueSetSizes[i], fscore[i]);
+    }
+    fprintf(out, "\n");
+    // optional, after the fixed header lines above, which parsers index into
+    if (options.prMetrics) {
+        fprintf(out, "AUC_PR:");
+        for (unsigned int i=0; i<numSamples; ++i) {
+            fprintf(out, " %lf", results.curves[i].aucPR(trueSetSizes[i]));
+        }
+        fprintf(out, "\n");
+        fprintf(out, "BEST_FSCORE[FSCORE@QUAL]:");
+        for (unsigned int i=0; i<numSamples; ++i) {
+            const ROCCurve &curve = results.curves[i];
+            if (curve.points.empty()) {
+                fprintf(out, " -");
+                continue;
+            }
+            size_t best = curve.bestFScore(trueSetSizes[i]);
+            fprintf(out, " %lf@%lf", curve.fscore(best, trueSetSizes[i]), curve.points[best].score);
+        }
+        fprintf(out, "\n");
+    }
+    if (options.rocBinary != NULL) {
+        if (!writeROCBinary(options.rocBinary, plotFalsePositives, maxFalsePositives, plotter))
+            return false;
+    }
+    else {
+        for (size_t j=0; j<plotFalsePositives.size(); ++j) {
+            fprintf(out, "%lf", plotFalsePositives[j] / (double)maxFalsePositives);
+            for (unsigned int i=0; i<numSamples; ++i)
+                fprintf(out, " %lf", plotter.truePositiveRate(i, plotFalsePositives[j]));
+            fprintf(out, "\n");
+        }
+    }
+    if (options.prFile != NULL && !writePRFile(options.prFile, results.curves, names, trueSetSizes))
+        return false;
+    return true;
+}
+
+#define STREAM_BLOCK_SIZE (1024*1024) // bytes of a sample VCF read and normalised at a time
+
+// Reads a plain or compressed VCF a block of whole lines at a time
+class VCFBlockReader {
+protected:
+    gzFile in;
+    std::vector<char> buf;
+    size_t used;     // bytes read into buf
+    size_t returned; // bytes of buf returned by the last read()
+    bool error;
+
+public:
+    VCFBlockReader() : in(NULL), buf(STREAM_BLOCK_SIZE), used(0), returned(0), error(false) {}
+
+    ~VCFBlockReader() {
+        if (in != NULL)
+            gzclose(in);
+    }
+
+    bool open(const std::string &filename) {
+        in = gzopen(filename.c_str(), "rb");
+        if (in == NULL)
+            return false;
+        gzbuffer(in, 128*1024);
+        return true;
+    }
+
+    // the next block of whole lines as [*data, *end), the last line of the file possibly without a
+    // newline. False at the end of the file or if it cannot be read, see failed()
+    bool read(const char **data, const char **end) {
+        used -= returned;
+        memmove(&buf[0], &buf[returned], used);
+        returned = 0;
+        while (true) {
+            if (used == buf.size())
+                buf.resize(2*buf.size()); // a line longer than the block
+            int len = gzread(in, &buf[used], buf.size() - used);
+            if (len < 0) {
+                error = true;
+                return false;
+            }
+            if (len == 0 && used == 0)
+                return false;
+            const char *blockEnd = &buf[0] + used + len;
+            if (len > 0) {
+                used += len;
+                while (blockEnd > &buf[0] && blockEnd[-1] != '\n')
+                    blockEnd--;
+                if (blockEnd == &buf[0])
+                    continue;
+            }
+            *data = &buf[0];
+            *end = blockEnd;
+            returned = blockEnd - *data;
+            return true;
+        }
+    }
+
+    bool failed() const {
+        return error;
+    }
+};
+
+// Bits that threads may set concurrently, e.g. the gold set variants found by any sample
+class ConcurrentBitset {
+protected:
+    std::atomic<uint64_t> *words;
+    uint64_t numWords;
+
+public:
+    ConcurrentBitset(uint64_t size) {
+        numWords = (size + 63) / 64;
+        words = new std::atomic<uint64_t>[numWords];
+        for (uint64_t i=0; i<numWords; ++i)
+            words[i] = 0;
+    }
+
+    ~ConcurrentBitset() {
+        delete [] words;
+    }
+
+    void set(uint64_t i) {
+        words[i/64].fetch_or((uint64_t)1 << (i%64), std::memory_order_relaxed);
+    }
+
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (uint64_t i=0; i<numWords; ++i)
+            n += __builtin_popcountll(words[i].load(std::memory_order_relaxed));
+        return n;
+    }
+};
+
+// Evaluates a position-sorted sample VCF as it is read, without keeping its variants. Lines are
+// read and normalised a block at a time into a window. Variants more than NORMALIZE_PREFIX_LEN
+// bases before the last line read cannot be preceded or duplicated by a later line, so they are
+// sorted, deduplicated and merged with the gold set, and only their (score, isTP) pairs are kept.
+// Memory then depends on the gold set and the window, not on the size of the sample.
+class SampleStream {
+protected:
+    const VCFParser &goldSet;
+    std::map<int, uint64_t> goldBase;        // gold set index of the first variant of each chromosome
+    std::map<int, size_t> goldPos;           // next variant of each chromosome of the gold set to merge with
+    std::map<int, VariantStore> lastMerged;  // the last variant merged of each chromosome
+    VariantStore window;                     // variants not yet merged, in order read
+
+    struct RecordLess {
+        const VariantStore *store;
+        RecordLess(const VariantStore *store) : store(store) {}
+        bool operator()(const VariantRecord *X, const VariantRecord *Y) const {
+            return VariantStore::compare(*store, *X, *store, *Y) < 0;
+        }
+    };
+
+    struct RecordEqual {
+        const VariantStore *store;
+        RecordEqual(const VariantStore *store) : store(store) {}
+        bool operator()(const VariantRecord *X, const VariantRecord *Y) const {
+            return VariantStore::compare(*store, *X, *store, *Y) == 0;
+        }
+    };
+
+    // merge the window variants of chromosome chrom before position end (all if end is 0) with
+    // the gold set, keeping the others in rest. False if they are not after those merged before.
+    bool merge(int chrom, const std::vector<VariantRecord> &records, uint64_t end, VariantStore *rest) {
+        std::vector<const VariantRecord *> batch;
+        for (size_t i=0; i<records.size(); ++i) {
+            if (end == 0 || records[i].pos < end)
+                batch.push_back(&records[i]);
+            else
+                rest->add(chrom, records[i].pos, records[i].srcLen, window.allele(records[i]), records[i].dstLen, records[i].qual);
+        }
+        if (batch.empty())
+            return true;
+        std::stable_sort(batch.begin(), batch.end(), RecordLess(&window));
+        batch.erase(std::unique(batch.begin(), batch.end(), RecordEqual(&window)), batch.end());
+
+        std::map<int, VariantStore>::iterator lastIt = lastMerged.find(chrom);
+        if (lastIt != lastMerged.end()) {
+            const VariantRecord &last = lastIt->second.begin()->second[0];
+            if (VariantStore::compare(lastIt->second, last, window, *batch[0]) >= 0)
+                return false;
+        }
+        VariantStore &last = lastMerged[chrom];
+        last = VariantStore();
+        const VariantRecord &back = *batch.back();
+        last.add(chrom, back.pos, back.srcLen, window.allele(back), back.dstLen, back.qual);
+
+        static const std::vector<VariantRecord> noRecords;
+        VariantStore::const_iterator goldIt = goldSet.variantDB.begin();
+        std::map<int, uint64_t>::const_iterator baseIt = goldBase.find(chrom);
+        const std::vector<VariantRecord> *goldRecords = &noRecords;
+        uint64_t base = 0;
+        if (baseIt != goldBase.end()) {
+            while (goldIt->first != chrom)
+                ++goldIt;
+            goldRecords = &goldIt->second;
+            base = baseIt->second;
+        }
+        size_t &j = goldPos[chrom];
+        for (size_t i=0; i<batch.size(); ++i) {
+            int c = 1;
+            while (j < goldRecords->size() && (c = VariantStore::compare(window, *batch[i], goldSet.variantDB, (*goldRecords)[j])) > 0)
+                j++;
+            ScoredVariant variant;
+            variant.score = batch[i]->qual;
+            variant.isTruePositive = (j < goldRecords->size() && c == 0);
+            if (variant.isTruePositive) {
+                goldFound->set(base + j);
+                numTruePositives++;
+                j++;
+            }
+            scored.push_back(variant);
+        }
+        return true;
+    }
+
+    // merge the window variants that no line after the one at chrom and pos can precede, all if
+    // chrom is not known
+    bool flush(int chrom, bool chromKnown, uint64_t pos) {
+        VariantStore rest;
+        bool ok = true;
+        for (VariantStore::const_iterator it = window.begin(); ok && it != window.end(); ++it) {
+            uint64_t end = 0;
+            if (chromKnown && it->first == chrom)
+                end = (pos > NORMALIZE_PREFIX_LEN) ? pos - NORMALIZE_PREFIX_LEN : 1;
+            ok = merge(it->first, it->second, end, &rest);
+        }
+        window = rest;
+        return ok;
+    }
+
+public:
+    ConcurrentBitset *goldFound;       // gold set variants found, by gold set index
+    std::vector<ScoredVariant> scored; // every distinct variant of the sample
+    uint64_t numTruePositives;
+    const char *error;                 // why evaluate() failed
+
+    SampleStream(const VCFParser &goldSet, ConcurrentBitset *goldFound) : goldSet(goldSet), goldFound(goldFound), numTruePositives(0), error(NULL) {
+        uint64_t base = 0;
+        for (VariantStore::const_iterator it = goldSet.variantDB.begin(); it != goldSet.variantDB.end(); ++it) {
+            goldBase[it->first] = base;
+            base += it->second.size();
+        }
+    }
+
+    // read and evaluate a sample VCF, plain or compressed, false if it cannot be read or is not sorted
+    bool evaluate(const std::string &filename, const int compareType, ParseRefFA *parseRefFA, const RegionSet *regions) {
+        VCFBlockReader reader;
+        if (!reader.open(filename)) {
+            error = "unable to open";
+            return false;
+        }
+        const ContigDictionary &contigs = goldSet.getContigs();
+        std::set<std::string> ignored;
+        const char *data, *end;
+        bool ok = true;
+        while (ok && reader.read(&data, &end)) {
+            VariantStore block;
+            goldSet.parseChunk(compareType, data, end, parseRefFA, regions, block, ignored);
+            window.append(block);
+
+            // chromosome and position of the last line of the block
+            const char *line = end - 1;
+            while (line > data && line[-1] != '\n')
+                line--;
+            if (*line == '#')
+                continue;
+            const char *chromEnd = line;
+            while (chromEnd < end && *chromEnd != '\t' && *chromEnd != ' ' && *chromEnd != '\n')
+                chromEnd++;
+            int chrom = contigs.find(std::string(line, chromEnd));
+            ok = flush(chrom, chrom >= 0, (chrom >= 0) ? strtoull(chromEnd, NULL, 10) : 0);
+        }
+        if (reader.failed()) {
+            error = "unable to read";
+            return false;
+        }
+        // the variants left in the window at the end of the file
+        if (ok)
+            ok = flush(0, false, 0);
+        if (!ok)
+            error = "not sorted by position";
+        return ok;
+    }
+};
+
+// evaluates sample VCFs as they are read, the samples in parallel
+struct StreamTask {
+    const VCFParser *goldSet;
+    const std::vector<std::string> *filenames;
+    int compareType;
+    ParseRefFA *parseRefFA;
+    const RegionSet *regions;
+    ConcurrentBitset *goldFound;
+    SampleResults *results;
+    std::vector<const char *> errors; // NULL when a sample was evaluated
+
+    void operator()(unsigned int i) {
+        SampleStream stream(*goldSet, goldFound);
+        if (!stream.evaluate((*filenames)[i], compareType, parseRefFA, regions)) {
+            errors[i] = stream.error;
+            return;
+        }
+        results->sizes[i] = stream.scored.size();
+        results->truePositives[i] = stream.numTruePositives;
+        results->goldTruePositives[i] = stream.numTruePositives;
+        results->curves[i].build(stream.scored);
+    }
+};
+
+// matches a sample against the gold set and prints its precision, recall and F-score, false if an output could not be written
+bool reportSample(FILE *out, const ReportOptions &options, const VCFParser &goldSet, VCFParser &sampleSet, const std::string &name) {
+    if (options.profile != NULL)
+        options.profile->begin("match");
+    std::vector<bool> goldMatched(goldSet.size());
+    sampleSet.matchTruePositives(goldSet, &goldMatched, options.fuzzy);
+    if (options.profile != NULL)
+        options.profile->begin("roc");
+
+    SampleResults results;
+    results.sizes.push_back(sampleSet.size());
+    results.truePositives.push_back(sampleSet.numTruePositives());
+    results.goldTruePositives.push_back(sampleSet.numGoldTruePositives());
+    results.numUnionPositives = sampleSet.numGoldTruePositives();
+    if (options.prFile != NULL) {
+        results.curves.resize(1);
+        std::vector<ScoredVariant> scored;
+        sampleSet.getScoredVariants(&scored);
+        results.curves[0].build(scored);
+    }
+    if (!printSample(out, options, goldSet.size(), results, name))
+        return false;
+    if (options.bootstrapReplicates > 0) {
+        if (options.profile != NULL)
+            options.profile->begin("bootstrap");
+        Bootstrap bootstrap(options.bootstrapBlock);
+        bootstrap.count(goldSet.variantDB, std::vector<const VariantStore *>(1, &sampleSet.variantDB), std::vector<const std::vector<bool> *>(1, &goldMatched));
+        bootstrap.run(options.bootstrapReplicates, options.numThreads);
+        bootstrap.write(out, std::vector<std::string>(1, name));
+    }
+    if (options.stratifier != NULL) {
+        if (options.profile != NULL)
+            options.profile->begin("strata");
+        std::vector<StratumCounts> counts;
+        options.stratifier->count(goldSet.variantDB, sampleSet.variantDB, goldMatched, options.numThreads, &counts);
+        options.stratifier->write(options.strataOut, name.c_str(), counts);
+    }
+    if (options.profile != NULL)
+        options.profile->end();
+    return true;
+}
+
+// matches samples against the gold set and prints their ROC, false if an output could not be written
+bool reportROC(FILE *out, const ReportOptions &options, const VCFParser &goldSet, const std::vector<VCFParser *> &sampleSets, const std::vector<std::string> &names) {
+    unsigned int numSamples = sampleSets.size();
+    uint64_t trueSetSize = goldSet.size();
+    if (options.profile != NULL)
+        options.profile->begin("match");
+    MatchTask matchTask;
+    matchTask.goldSet = &goldSet;
+    matchTask.fuzzy = options.fuzzy;
+    matchTask.sampleSets = sampleSets;
+    matchTask.positiveVariants.resize(numSamples);
+    parallelFor(numSamples, options.numThreads, matchTask);
+    if (options.profile != NULL)
+        options.profile->begin("roc");
+    CurveTask curveTask;
+    curveTask.sampleSets = sampleSets;
+    curveTask.curves.resize(numSamples);
+    parallelFor(numSamples, options.numThreads, curveTask);
+
+    SampleResults results;
+    std::vector<bool> positiveVariants(trueSetSize); // union of all true positives found across samples, by gold set index
+    for (unsigned int i=0; i<numSamples; ++i) {
+        for (uint64_t j=0; j<trueSetSize; ++j) {
+            if (matchTask.positiveVariants[i][j])
+                positiveVariants[j] = true;
+        }
+        results.sizes.push_back(sampleSets[i]->size());
+        results.truePositives.push_back(sampleSets[i]->numTruePositives());
+        results.goldTruePositives.push_back(sampleSets[i]->numGoldTruePositives());
+    }
+    results.curves.swap(curveTask.curves);
+    results.numUnionPositives = std::count(positiveVariants.begin(), positiveVariants.end(), true);
+    if (!printROC(out, options, trueSetSize, results, names))
+        return false;
+    if (options.bootstrapReplicates > 0) {
+        if (options.profile != NULL)
+            options.profile->begin("bootstrap");
+        std::vector<const VariantStore *> samples;
+        std::vector<const std::vector<bool> *> goldMatched;
+        for (unsigned int i=0; i<numSamples; ++i) {
+            samples.push_back(&sampleSets[i]->variantDB);
+            goldMatched.push_back(&matchTask.positiveVariants[i]);
+        }
+        Bootstrap bootstrap(options.bootstrapBlock);
+        bootstrap.count(goldSet.variantDB, samples, goldMatched);
+        bootstrap.run(options.bootstrapReplicates, options.numThreads);
+        bootstrap.write(out, names);
+    }
+    if (options.stratifier != NULL) {
+        if (options.profile != NULL)
+            options.profile->begin("strata");
+        std::vector<StratumCounts> counts;
+        for (unsigned int i=0; i<numSamples; ++i) {
+            options.stratifier->count(goldSet.variantDB, sampleSets[i]->variantDB, matchTask.positiveVariants[i], options.numThreads, &counts);
+            options.stratifier->write(options.strataOut, names[i].c_str(), counts);
+        }
+    }
+    if (options.profile != NULL)
+        options.profile->end();
+    return true;
+}
+
+// evaluates each sample column of jointFile against the column of the same name in goldFile, or
+// against all variants of goldFile if it has none, parsing each file once for all its samples, and
+// prints their metrics as reportSample or reportROC. False if a file could not be parsed or an output
+// could not be written
+bool reportMultiSample(FILE *out, const ReportOptions &options, const ContigDictionary *contigs, const std::string &goldFile, const std::string &jointFile,
+                       const int compareType, ParseRefFA *parseRefFA, const RegionSet *regions) {
+    if (options.profile != NULL)
+        options.profile->begin("parse");
+    MultiSampleVCF goldVCF(contigs, true, compareType, parseRefFA, regions);
+    MultiSampleVCF jointVCF(contigs, false, compareType, parseRefFA, regions);
+    std::vector<VCFParser *> goldSets, sampleSets;
+    if (!goldVCF.readHeader(goldFile) || !goldVCF.parse(goldFile, options.numThreads, &goldSets)) {
+        printf("Error - unable to parse file %s\n", goldFile.c_str());
+        return false;
+    }
+    bool ok = false;
+    if (!jointVCF.readHeader(jointFile) || !jointVCF.parse(jointFile, options.numThreads, &sampleSets))
+        printf("Error - unable to parse file %s\n", jointFile.c_str());
+    else if (sampleSets.empty())
+        printf("Error - file %s has no sample columns\n", jointFile.c_str());
+    else
+        ok = true;
+    if (!ok) {
+        for (size_t i=0; i<goldSets.size(); ++i)
+            delete goldSets[i];
+        for (size_t i=0; i<sampleSets.size(); ++i)
+            delete sampleSets[i];
+        return false;
+    }
+    const std::vector<std::string> &names = jointVCF.names;
+    unsigned int numSamples = sampleSets.size();
+
+    // the truth set of each sample, goldSets[0] being the variants of all gold set sites
+    std::vector<const VCFParser *> truthSets(numSamples, goldSets[0]);
+    bool ownTruth = false;
+    for (unsigned int i=0; i<numSamples; ++i) {
+        std::vector<std::string>::const_iterator it = std::find(goldVCF.names.begin(), goldVCF.names.end(), names[i]);
+        if (it != goldVCF.names.end()) {
+            truthSets[i] = goldSets[1 + (it - goldVCF.names.begin())];
+            ownTruth = true;
+        }
+    }
+
+    if (options.profile != NULL)
+        options.profile->begin("match");
+    MatchTask matchTask;
+    matchTask.goldSet = NULL;
+    matchTask.goldSets = truthSets;
+    matchTask.fuzzy = options.fuzzy;
+    matchTask.sampleSets = sampleSets;
+    matchTask.positiveVariants.resize(numSamples);
+    parallelFor(numSamples, options.numThreads, matchTask);
+    if (options.profile != NULL)
+        options.profile->begin("roc");
+    CurveTask curveTask;
+    if (numSamples > 1 || options.prFile != NULL) {
+        curveTask.sampleSets = sampleSets;
+        curveTask.curves.resize(numSamples);
+        parallelFor(numSamples, options.numThreads, curveTask);
+    }
+
+    SampleResults results;
+    for (unsigned int i=0; i<numSamples; ++i) {
+        results.sizes.push_back(sampleSets[i]->size());
+        results.truePositives.push_back(sampleSets[i]->numTruePositives());
+        results.goldTruePositives.push_back(sampleSets[i]->numGoldTruePositives());
+        // union of the true positives found by the samples sharing the truth set of sample i
+        std::vector<bool> positiveVariants(truthSets[i]->size());
+        for (unsigned int j=0; j<numSamples; ++j) {
+            if (truthSets[j] != truthSets[i])
+                continue;
+            for (uint64_t k=0; k<positiveVariants.size(); ++k) {
+                if (matchTask.positiveVariants[j][k])
+                    positiveVariants[k] = true;
+            }
+        }
+        results.trueSetSizes.push_back(truthSets[i]->size());
+        results.unionPositives.push_back(std::count(positiveVariants.begin(), positiveVariants.end(), true));
+        if (truthSets[i] == goldSets[0])
+            results.numUnionPositives = results.unionPositives.back();
+    }
+    // with one truth set for all the output is that of separate sample VCFs
+    if (!ownTruth) {
+        results.numUnionPositives = results.unionPositives[0];
+        results.trueSetSizes.clear();
+        results.unionPositives.clear();
+    }
+    else if (std::find(truthSets.begin(), truthSets.end(), goldSets[0]) == truthSets.end())
+        results.numUnionPositives = 0;
+    results.curves.swap(curveTask.curves);
+    if (numSamples == 1)
+        ok = printSample(out, options, truthSets[0]->size(), results, names[0]);
+    else
+        ok = printROC(out, options, goldSets[0]->size(), results, names);
+    if (ok && options.stratifier != NULL) {
+        if (options.profile != NULL)
+            options.profile->begin("strata");
+        std::vector<StratumCounts> counts;
+        for (unsigned int i=0; i<numSamples; ++i) {
+            options.stratifier->count(truthSets[i]->variantDB, sampleSets[i]->variantDB, matchTask.positiveVariants[i], options.numThreads, &counts);
+            options.stratifier->write(options.strataOut, names[i].c_str(), counts);
+        }
+    }
+    if (options.profile != NULL)
+        options.profile->end();
+    for (size_t i=0; i<goldSets.size(); ++i)
+        delete goldSets[i];
+    for (unsigned int i=0; i<numSamples; ++i)
+        delete sampleSets[i];
+    return ok;
+}
+
+// matches every sample against every truth set, the samples in parallel for one truth set at a time
+// as matching marks the sample's variants, and prints a table of each metric with a row per truth
+// set and a column per sample. The AUC of a row is that of reportROC against the row's truth set.
+// False if an output could not be written
+bool reportMatrix(FILE *out, const ReportOptions &options, const std::vector<VCFParser *> &truthSets, const std::vector<VCFParser *> &sampleSets,
+                  const std::vector<std::string> &truthNames, const std::vector<std::string> &names) {
+    unsigned int numTruthSets = truthSets.size();
+    unsigned int numSamples = sampleSets.size();
+    // metrics by truth set then sample
+    const unsigned int numMetrics = 5;
+    const char *labels[numMetrics] = { "AUC", "PREC", "RECALL", "FSCORE", "AUC_PR" };
+    const char *keys[numMetrics] = { "auc", "precision", "recall", "fscore", "auc_pr" };
+    std::vector<std::vector<double> > metrics[numMetrics];
+    for (unsigned int k=0; k<numMetrics; ++k)
+        metrics[k].assign(numTruthSets, std::vector<double>(numSamples));
+    std::vector<uint64_t> unionPositives(numTruthSets);
+
+    if (options.profile != NULL)
+        options.profile->begin("match");
+    for (unsigned int t=0; t<numTruthSets; ++t) {
+        const VCFParser &goldSet = *truthSets[t];
+        uint64_t trueSetSize = goldSet.size();
+        MatchTask matchTask;
+        matchTask.goldSet = &goldSet;
+        matchTask.fuzzy = options.fuzzy;
+        matchTask.sampleSets = sampleSets;
+        matchTask.positiveVariants.resize(numSamples);
+        parallelFor(numSamples, options.numThreads, matchTask);
+        CurveTask curveTask;
+        curveTask.sampleSets = sampleSets;
+        curveTask.curves.resize(numSamples);
+        parallelFor(numSamples, options.numThreads, curveTask);
+
+        std::vector<bool> positiveVariants(trueSetSize);
+        uint64_t maxFalsePositives = 0;
+        for (unsigned int i=0; i<numSamples; ++i) {
+            for (uint64_t j=0; j<trueSetSize; ++j) {
+                if (matchTask.positiveVariants[i][j])
+                    positiveVariants[j] = true;
+            }
+            const std::vector<ROCCurve::Point> &points = curveTask.curves[i].points;
+            if (!points.empty() && points.back().falsePositives > maxFalsePositives)
+                maxFalsePositives = points.back().falsePositives;
+        }
+        unionPositives[t] = std::count(positiveVariants.begin(), positiveVariants.end(), true);
+        for (unsigned int i=0; i<numSamples; ++i) {
+            const VCFParser &sampleSet = *sampleSets[i];
+            uint64_t numTruePositives = sampleSet.numTruePositives();
+            uint64_t numGoldTruePositives = sampleSet.numGoldTruePositives();
+            uint64_t numFalsePositives = sampleSet.size() - numTruePositives;
+            uint64_t numFalseNegatives = trueSetSize - numGoldTruePositives;
+            std::vector<std::pair<uint64_t, uint64_t> > plot;
+            metrics[0][t][i] = curveTask.curves[i].auc(unionPositives[t], maxFalsePositives, &plot);
+            metrics[1][t][i] = (double)numTruePositives / (double)sampleSet.size();
+            metrics[2][t][i] = (double)numGoldTruePositives / (double)trueSetSize;
+            metrics[3][t][i] = (double)(numTruePositives+numGoldTruePositives)/(double)(numTruePositives+numGoldTruePositives+numFalsePositives+numFalseNegatives);
+            metrics[4][t][i] = curveTask.curves[i].aucPR(trueSetSize);
+        }
+    }
+    if (options.profile != NULL)
+        options.profile->end();
+
+    if (options.rocJSON) {
+        fprintf(out, "{\"truth_sets\":[");
+        for (unsigned int t=0; t<numTruthSets; ++t) {
+            fprintf(out, "%s{\"name\":", t ? "," : "");
+            writeJSONString(out, truthNames[t]);
+            fprintf(out, ",\"true_set_size\":%" PRIu64 ",\"union_positives\":%" PRIu64 "}", truthSets[t]->size(), unionPositives[t]);
+        }
+        fprintf(out, "],\"samples\":[");
+        for (unsigned int i=0; i<numSamples; ++i) {
+            fprintf(out, "%s", i ? "," : "");
+            writeJSONString(out, names[i]);
+        }
+        fprintf(out, "]");
+        for (unsigned int k=0; k<numMetrics; ++k) {
+            fprintf(out, ",\"%s\":[", keys[k]);
+            for (unsigned int t=0; t<numTruthSets; ++t) {
+                fprintf(out, "%s[", t ? "," : "");
+                for (unsigned int i=0; i<numSamples; ++i) {
+                    fprintf(out, "%s", i ? "," : "");
+                    writeJSONNumber(out, metrics[k][t][i]);
+                }
+                fprintf(out, "]");
+            }
+            fprintf(out, "]");
+        }
+        fprintf(out, "}\n");
+        return true;
+    }
+    for (unsigned int k=0; k<numMetrics; ++k) {
+        fprintf(out, "MATRIX[%s]", labels[k]);
+        for (unsigned int i=0; i<numSamples; ++i)
+            fprintf(out, "\t%s", names[i].c_str());
+        fprintf(out, "\n");
+        for (unsigned int t=0; t<numTruthSets; ++t) {
+            fprintf(out, "%s", truthNames[t].c_str());
+            for (unsigned int i=0; i<numSamples; ++i)
+                fprintf(out, "\t%lf", metrics[k][t][i]);
+            fprintf(out, "\n");
+        }
+    }
+    return true;
+}
+
+// evaluates sample VCFs as they are read (see SampleStream) and prints their metrics as reportSample
+// or reportROC, false if a sample could not be evaluated or an output could not be written
+bool reportStream(FILE *out, const ReportOptions &options, const VCFParser &goldSet, const std::vector<std::string> &filenames, const int compareType, ParseRefFA *parseRefFA, const RegionSet *regions) {
+    unsigned int numSamples = filenames.size();
+    ConcurrentBitset goldFound(goldSet.size());
+    SampleResults results;
+    results.sizes.resize(numSamples);
+    results.truePositives.resize(numSamples);
+    results.goldTruePositives.resize(numSamples);
+    results.curves.resize(numSamples);
+    StreamTask task;
+    task.goldSet = &goldSet;
+    task.filenames = &filenames;
+    task.compareType = compareType;
+    task.parseRefFA = parseRefFA;
+    task.regions = regions;
+    task.goldFound = &goldFound;
+    task.results = &results;
+    task.errors.resize(numSamples, NULL);
+    parallelFor(numSamples, options.numThreads, task);
+    for (unsigned int i=0; i<numSamples; ++i) {
+        if (task.errors[i] != NULL) {
+            fprintf(out, "Error - unable to parse file %s: %s\n", filenames[i].c_str(), task.errors[i]);
+            return false;
+        }
+    }
+    results.numUnionPositives = goldFound.count();
+    if (numSamples == 1)
+        return printSample(out, options, goldSet.size(), results, filenames[0]);
+    return printROC(out, options, goldSet.size(), results, filenames);
+}
+
+#define EXTERNAL_IO_BUFFER (256*1024) // bytes buffered for each file of runs read or written
+#define EXTERNAL_MAX_FAN_IN 64         // runs merged at once, more are merged in passes to keep few files open
+
+// Variant of a sorted run on disk, followed there by the dstLen bytes of its alternate allele
+struct RunRecord {
+    int32_t chrom;
+    uint32_t srcLen;
+    uint32_t dstLen;
+    uint32_t unused;
+    uint64_t pos;
+    double qual;
+};
+
+// orders variants as VariantStore::compare, by chromosome first
+static int compareRunRecords(const RunRecord &X, const std::string &xAllele, const RunRecord &Y, const std::string &yAllele) {
+    if (X.chrom != Y.chrom)
+        return (X.chrom < Y.chrom) ? -1 : 1;
+    if (X.pos != Y.pos)
+        return (X.pos < Y.pos) ? -1 : 1;
+    if (X.srcLen != Y.srcLen)
+        return (X.srcLen < Y.srcLen) ? -1 : 1;
+    int c = memcmp(xAllele.data(), yAllele.data(), (X.dstLen < Y.dstLen) ? X.dstLen : Y.dstLen);
+    if (c != 0)
+        return c;
+    if (X.dstLen != Y.dstLen)
+        return (X.dstLen < Y.dstLen) ? -1 : 1;
+    return 0;
+}
+
+// File of sorted variants, written once and then read back in order. A temporary file is removed
+// when the run is deleted.
+class VariantRun {
+protected:
+    std::string path;
+    bool temporary;
+    FILE *file;
+    std::vector<char> buffer;
+
+public:
+    RunRecord record; // the variant last read
+    std::string allele;
+
+    VariantRun(const std::string &path, bool temporary = true) : path(path), temporary(temporary), file(NULL) {}
+
+    ~VariantRun() {
+        if (file != NULL)
+            fclose(file);
+        if (temporary)
+            unlink(path.c_str());
+    }
+
+    // open for writing if write, else for reading from the start
+    bool open(bool write) {
+        if (file != NULL)
+            fclose(file);
+        file = fopen(path.c_str(), write ? "w" : "r");
+        if (file == NULL)
+            return false;
+        buffer.resize(EXTERNAL_IO_BUFFER);
+        setvbuf(file, &buffer[0], _IOFBF, buffer.size());
+        return true;
+    }
+
+    bool write(const RunRecord &variant, const char *dst) {
+        return fwrite(&variant, sizeof(variant), 1, file) == 1 && fwrite(dst, 1, variant.dstLen, file) == variant.dstLen;
+    }
+
+    // write the records of a finished store
+    bool write(const VariantStore &store) {
+        RunRecord variant;
+        memset(&variant, 0, sizeof(variant));
+        for (VariantStore::const_iterator it = store.begin(); it != store.end(); ++it) {
+            variant.chrom = it->first;
+            for (std::vector<VariantRecord>::const_iterator record = it->second.begin(); record != it->second.end(); ++record) {
+                variant.pos = record->pos;
+                variant.srcLen = record->srcLen;
+                variant.dstLen = record->dstLen;
+                variant.qual = record->qual;
+                if (!write(variant, store.allele(*record)))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // flush and close after writing, false if it could not be written
+    bool close() {
+        bool ok = fclose(file) == 0;
+        file = NULL;
+        return ok;
+    }
+
+    // the next variant into record and allele, false at the end of the run
+    bool read() {
+        if (fread(&record, sizeof(record), 1, file) != 1)
+            return false;
+        allele.resize(record.dstLen);
+        return record.dstLen == 0 || fread(&allele[0], 1, record.dstLen, file) == record.dstLen;
+    }
+};
+
+// Merges sorted runs into one sorted sequence without duplicates, keeping the variant of the
+// earliest run as VariantStore::finish keeps the first added
+class RunMerger {
+protected:
+    std::vector<VariantRun *> runs;
+    std::vector<unsigned int> heap; // runs with variants left, the smallest variant on top
+
+    struct After {
+        const std::vector<VariantRun *> *runs;
+        After(const std::vector<VariantRun *> *runs) : runs(runs) {}
+        bool operator()(unsigned int a, unsigned int b) const {
+            int c = compareRunRecords((*runs)[a]->record, (*runs)[a]->allele, (*runs)[b]->record, (*runs)[b]->allele);
+            return c > 0 || (c == 0 && a > b);
+        }
+    };
+
+    // move run i past its current variant
+    void advance(unsigned int i) {
+        std::pop_heap(heap.begin(), heap.end(), After(&runs));
+        if (runs[i]->read())
+            std::push_heap(heap.begin(), heap.end(), After(&runs));
+        else
+            heap.pop_back();
+    }
+
+public:
+    RunRecord record; // the variant last returned by next()
+    std::string allele;
+
+    // runs already written and closed, false if one cannot be opened
+    bool open(const std::vector<VariantRun *> &sortedRuns) {
+        runs = sortedRuns;
+        heap.clear();
+        for (unsigned int i=0; i<runs.size(); ++i) {
+            if (!runs[i]->open(false))
+                return false;
+            if (runs[i]->read())
+                heap.push_back(i);
+        }
+        std::make_heap(heap.begin(), heap.end(), After(&runs));
+        return true;
+    }
+
+    // the next distinct variant into record and allele, false when all are merged
+    bool next() {
+        if (heap.empty())
+            return false;
+        unsigned int i = heap.front();
+        record = runs[i]->record;
+        allele = runs[i]->allele;
+        advance(i);
+        while (!heap.empty() && compareRunRecords(runs[heap.front()]->record, runs[heap.front()]->allele, record, allele) == 0)
+            advance(heap.front());
+        return true;
+    }
+};
+
+// merges consecutive runs EXTERNAL_MAX_FAN_IN at a time, in passes until there are at most that
+// many, into files named prefix.merged.0, prefix.merged.1... The merged runs replace those in runs
+// in order, so the variant of the earliest run is still the one kept. False with error set if a run
+// cannot be read or written.
+bool mergeRunPasses(std::vector<VariantRun *> *runs, const std::string &prefix, const char **error) {
+    unsigned int numMerged = 0;
+    bool ok = true;
+    while (ok && runs->size() > EXTERNAL_MAX_FAN_IN) {
+        std::vector<VariantRun *> merged;
+        size_t first = 0;
+        for (; ok && first < runs->size(); first += EXTERNAL_MAX_FAN_IN) {
+            size_t last = std::min(first + EXTERNAL_MAX_FAN_IN, runs->size());
+            if (last - first == 1) {
+                merged.push_back((*runs)[first]);
+                continue;
+            }
+            std::vector<VariantRun *> group(runs->begin() + first, runs->begin() + last);
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), ".merged.%u", numMerged++);
+            VariantRun *run = new VariantRun(prefix + suffix);
+            merged.push_back(run);
+            RunMerger merger;
+            if (!merger.open(group)) {
+                *error = "unable to read a sorted run";
+                ok = false;
+            }
+            else if (!run->open(true)) {
+                *error = "unable to write a sorted run";
+                ok = false;
+            }
+            else {
+                while (ok && merger.next())
+                    ok = run->write(merger.record, merger.allele.data());
+                if (!run->close() || !ok) {
+                    *error = "unable to write a sorted run";
+                    ok = false;
+                }
+            }
+            for (size_t i=0; i<group.size(); ++i)
+                delete group[i];
+        }
+        // runs not reached after a failure are left for the caller to delete
+        merged.insert(merged.end(), runs->begin() + std::min(first, runs->size()), runs->end());
+        *runs = merged;
+    }
+    return ok;
+}
+
+// parse a VCF with parser's contigs into sorted, deduplicated runs of about budget bytes of variants
+// each, written to files named prefix.0, prefix.1..., and merged down to EXTERNAL_MAX_FAN_IN runs at
+// most. False with error set if it cannot be read or a run written.
+bool spillVCF(const VCFParser &parser, const std::string &filename, const int compareType, ParseRefFA *parseRefFA, const RegionSet *regions,
+              uint64_t budget, const std::string &prefix, std::vector<VariantRun *> *runs, const char **error) {
+    VCFBlockReader reader;
+    if (!reader.open(filename)) {
+        *error = "unable to open";
+        return false;
+    }
+    VariantStore buffer;
+    std::set<std::string> ignored;
+    const char *data, *end;
+    bool more = true;
+    while (more) {
+        more = reader.read(&data, &end);
+        if (more) {
+            VariantStore block;
+            parser.parseChunk(compareType, data, end, parseRefFA, regions, block, ignored);
+            buffer.append(block);
+        }
+        else if (reader.failed()) {
+            *error = "unable to read";
+            return false;
+        }
+        if (buffer.bytes() < budget && (more || buffer.size() == 0))
+            continue;
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%u", (unsigned int)runs->size());
+        VariantRun *run = new VariantRun(prefix + suffix);
+        runs->push_back(run);
+        buffer.finish();
+        if (!run->open(true) || !run->write(buffer) || !run->close()) {
+            *error = "unable to write a sorted run";
+            return false;
+        }
+        buffer = VariantStore();
+    }
+    return mergeRunPasses(runs, prefix, error);
+}
+
+// Sorts the (score, isTP) pairs of a sample by score in runs of at most budget bytes, spilling them
+// to disk when there are more, and counts them into a ROC curve in order of score
+class ScoreSorter {
+protected:
+    std::string prefix;
+    size_t capacity; // pairs in memory at most
+    std::vector<ScoredVariant> buffer;
+    std::vector<std::string> runFiles;
+
+    bool spill() {
+        std::sort(buffer.begin(), buffer.end());
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".scores.%u", (unsigned int)runFiles.size());
+        runFiles.push_back(prefix + suffix);
+        FILE *out = fopen(runFiles.back().c_str(), "w");
+        if (out == NULL)
+            return false;
+        bool ok = buffer.empty() || fwrite(&buffer[0], sizeof(ScoredVariant), buffer.size(), out) == buffer.size();
+        ok = (fclose(out) == 0) && ok;
+        buffer.clear();
+        return ok;
+    }
+
+    // run files read back, with their next pair
+    struct ScoreRun {
+        FILE *file;
+        ScoredVariant next;
+    };
+
+    struct After {
+        const std::vector<ScoreRun> *runs;
+        After(const std::vector<ScoreRun> *runs) : runs(runs) {}
+        bool operator()(unsigned int a, unsigned int b) const {
+            return (*runs)[b].next < (*runs)[a].next;
+        }
+    };
+
+public:
+    bool failed;
+
+    ScoreSorter(const std::string &prefix, uint64_t budget) : prefix(prefix), failed(false) {
+        capacity = budget / sizeof(ScoredVariant) + 1;
+    }
+
+    ~ScoreSorter() {
+        for (size_t i=0; i<runFiles.size(); ++i)
+            unlink(runFiles[i].c_str());
+    }
+
+    void add(double score, bool isTruePositive) {
+        ScoredVariant variant;
+        variant.score = score;
+        variant.isTruePositive = isTruePositive;
+        buffer.push_back(variant);
+        if (buffer.size() >= capacity && !spill())
+            failed = true;
+    }
+
+    // merges the run files [first, last) into out if given, else into curve, false if one could
+    // not be read or out written
+    bool merge(size_t first, size_t last, FILE *out, ROCCurve *curve) {
+        std::vector<ScoreRun> runs(last - first);
+        std::vector<unsigned int> heap;
+        std::vector<std::vector<char> > buffers(runs.size(), std::vector<char>(EXTERNAL_IO_BUFFER));
+        bool ok = true;
+        for (unsigned int i=0; i<runs.size(); ++i) {
+            runs[i].file = fopen(runFiles[first+i].c_str(), "r");
+            if (runs[i].file == NULL) {
+                ok = false;
+                continue;
+            }
+            setvbuf(runs[i].file, &buffers[i][0], _IOFBF, buffers[i].size());
+            if (fread(&runs[i].next, sizeof(ScoredVariant), 1, runs[i].file) == 1)
+                heap.push_back(i);
+        }
+        std::make_heap(heap.begin(), heap.end(), After(&runs));
+        while (ok && !heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), After(&runs));
+            ScoreRun &run = runs[heap.back()];
+            if (out != NULL)
+                ok = fwrite(&run.next, sizeof(ScoredVariant), 1, out) == 1;
+            else
+                curve->add(run.next);
+            if (fread(&run.next, sizeof(ScoredVariant), 1, run.file) == 1)
+                std::push_heap(heap.begin(), heap.end(), After(&runs));
+            else
+                heap.pop_back();
+        }
+        for (unsigned int i=0; i<runs.size(); ++i) {
+            if (runs[i].file != NULL)
+                fclose(runs[i].file);
+        }
+        return ok;
+    }
+
+    // the ROC curve of all pairs added, merging the runs EXTERNAL_MAX_FAN_IN at a time in passes
+    // until there are at most that many, false if a run could not be written or read
+    bool build(ROCCurve *curve) {
+        if (failed)
+            return false;
+        if (runFiles.empty()) {
+            curve->build(buffer);
+            return true;
+        }
+        if (!buffer.empty() && !spill())
+            return false;
+        unsigned int numMerged = 0;
+        while (runFiles.size() > EXTERNAL_MAX_FAN_IN) {
+            std::vector<std::string> merged;
+            for (size_t first = 0; first < runFiles.size(); first += EXTERNAL_MAX_FAN_IN) {
+                size_t last = std::min(first + EXTERNAL_MAX_FAN_IN, runFiles.size());
+                char suffix[32];
+                snprintf(suffix, sizeof(suffix), ".scores.merged.%u", numMerged++);
+                merged.push_back(prefix + suffix);
+                FILE *out = fopen(merged.back().c_str(), "w");
+                bool ok = out != NULL && merge(first, last, out, NULL);
+                ok = (out == NULL || fclose(out) == 0) && ok;
+                for (size_t i=first; i<last; ++i)
+                    unlink(runFiles[i].c_str());
+                if (!ok) {
+                    // the runs not reached are still removed by the destructor
+                    runFiles.erase(runFiles.begin(), runFiles.begin() + last);
+                    runFiles.insert(runFiles.end(), merged.begin(), merged.end());
+                    return false;
+                }
+            }
+            runFiles = merged;
+        }
+        curve->points.clear();
+        return merge(0, runFiles.size(), NULL, curve);
+    }
+};
+
+// evaluates samples from disk against the merged gold set run, the samples in parallel
+struct ExternalTask {
+    const VCFParser *parser;
+    const std::vector<std::string> *filenames; // of the samples
+    std::string goldPath;
+    std::string tempPrefix;
+    int compareType;
+    ParseRefFA *parseRefFA;
+    const RegionSet *regions;
+    uint64_t budget;
+    ConcurrentBitset *goldFound;
+    SampleResults *results;
+    std::vector<const char *> errors; // NULL when a sample was evaluated
+
+    // merge join of the sample's runs with the gold set run
+    bool evaluate(unsigned int i, const std::string &prefix, const char **error) {
+        std::vector<VariantRun *> runs;
+        bool ok = spillVCF(*parser, (*filenames)[i], compareType, parseRefFA, regions, budget, prefix, &runs, error);
+        RunMerger sample;
+        VariantRun gold(goldPath, false);
+        if (ok && (!sample.open(runs) || !gold.open(false))) {
+            *error = "unable to read a sorted run";
+            ok = false;
+        }
+        if (ok) {
+            ScoreSorter sorter(prefix, budget);
+            uint64_t goldIndex = 0;
+            bool goldLeft = gold.read();
+            uint64_t size = 0, truePositives = 0;
+            while (sample.next()) {
+                int c = 1;
+                while (goldLeft && (c = compareRunRecords(sample.record, sample.allele, gold.record, gold.allele)) > 0) {
+                    goldLeft = gold.read();
+                    goldIndex++;
+                }
+                bool isTruePositive = (goldLeft && c == 0);
+                if (isTruePositive) {
+                    goldFound->set(goldIndex);
+                    truePositives++;
+                    goldLeft = gold.read();
+                    goldIndex++;
+                }
+                sorter.add(sample.record.qual, isTruePositive);
+                size++;
+            }
+            results->sizes[i] = size;
+            results->truePositives[i] = truePositives;
+            results->goldTruePositives[i] = truePositives;
+            if (!sorter.build(&results->curves[i])) {
+                *error = "unable to sort the scores on disk";
+                ok = false;
+            }
+        }
+        for (size_t j=0; j<runs.size(); ++j)
+            delete runs[j];
+        return ok;
+    }
+
+    void operator()(unsigned int i) {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%u", i+1);
+        evaluate(i, tempPrefix + suffix, &errors[i]);
+    }
+};
+
+// evaluates the sample VCFs of filenames against the gold set VCF, the first, and prints their metrics as
+// reportSample or reportROC. Both are normalised into sorted runs of at most about budget bytes in
+// temporary files in directory, which are merged, so memory does not depend on the size of the VCFs.
+// False if a VCF could not be evaluated or an output could not be written
+bool reportExternal(FILE *out, const ReportOptions &options, const ContigDictionary *contigs, const std::vector<std::string> &filenames, const int compareType,
+                    ParseRefFA *parseRefFA, const RegionSet *regions, const std::string &directory, uint64_t budget) {
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "/genotypeMetrics.%d", (int)getpid());
+    std::string tempPrefix = directory + prefix;
+    VCFParser parser(contigs);
+
+    // the gold set merged into a single run, to be read by each sample
+    if (options.profile != NULL)
+        options.profile->begin("gold");
+    const char *error = NULL;
+    std::vector<VariantRun *> goldRuns;
+    VariantRun gold(tempPrefix + ".gold");
+    uint64_t trueSetSize = 0;
+    if (spillVCF(parser, filenames[0], compareType, parseRefFA, regions, budget, tempPrefix + ".0", &goldRuns, &error)) {
+        RunMerger merger;
+        if (!merger.open(goldRuns) || !gold.open(true)) {
+            error = "unable to read a sorted run";
         }
-        // normalise x and y scale of AUC
-        for (int i=0; i<numSamples; ++i) {
-            AUC[i] /= numUnionPositiveVariants;
-            AUC[i] /= maxFalsePositives;
+        else {
+            bool ok = true;
+            while (ok && merger.next()) {
+                ok = gold.write(merger.record, merger.allele.data());
+                trueSetSize++;
+            }
+            if (!gold.close() || !ok)
+                error = "unable to write a sorted run";
         }
-        // print AUC along with filename
-        printf("NAMED_AUC:");
-        for (int i=0; i<numSamples; ++i) {
-            printf(" %s=%lf", argv[i+4],AUC[i]);
+    }
+    for (size_t i=0; i<goldRuns.size(); ++i)
+        delete goldRuns[i];
+    if (error != NULL) {
+        fprintf(out, "Error - unable to parse file %s: %s\n", filenames[0].c_str(), error);
+        return false;
+    }
+
+    if (options.profile != NULL)
+        options.profile->begin("match");
+    std::vector<std::string> names(filenames.begin()+1, filenames.end());
+    unsigned int numSamples = names.size();
+    unsigned int concurrent = (options.numThreads < numSamples) ? options.numThreads : numSamples;
+    ConcurrentBitset goldFound(trueSetSize);
+    SampleResults results;
+    results.sizes.resize(numSamples);
+    results.truePositives.resize(numSamples);
+    results.goldTruePositives.resize(numSamples);
+    results.curves.resize(numSamples);
+    ExternalTask task;
+    task.parser = &parser;
+    task.filenames = &names;
+    task.goldPath = tempPrefix + ".gold";
+    task.tempPrefix = tempPrefix;
+    task.compareType = compareType;
+    task.parseRefFA = parseRefFA;
+    task.regions = regions;
+    task.budget = budget / concurrent;
+    task.goldFound = &goldFound;
+    task.results = &results;
+    task.errors.resize(numSamples, NULL);
+    parallelFor(numSamples, options.numThreads, task);
+    for (unsigned int i=0; i<numSamples; ++i) {
+        if (task.errors[i] != NULL) {
+            fprintf(out, "Error - unable to parse file %s: %s\n", names[i].c_str(), task.errors[i]);
+            return false;
         }
-        printf("\n");
-        printf("AUC:");
-        for (int i=0; i<numSamples; ++i) {
-            printf(" %lf", AUC[i]);
+    }
+    if (options.profile != NULL)
+        options.profile->begin("roc");
+    results.numUnionPositives = goldFound.count();
+    bool ok;
+    if (numSamples == 1)
+        ok = printSample(out, options, trueSetSize, results, names[0]);
+    else
+        ok = printROC(out, options, trueSetSize, results, names);
+    if (options.profile != NULL)
+        options.profile->end();
+    return ok;
+}
+
+
+// Evaluates samples against a gold set and reference loaded once, for a request per line of
+// whitespace separated sample VCF paths. A request of one sample is answered as the precision,
+// recall and F-score mode, of more samples as the ROC mode, followed by a line "END". The gold set,
+// reference, regions and cache are read-only and shared by concurrent requests.
+class EvaluationServer {
+protected:
+    int compareType;
+    ParseRefFA *parseRefFA;
+    const RegionSet *regions;
+    const VariantCache *cache;
+    const VCFParser *goldSet;
+    const FuzzyMatcher *fuzzy;
+    unsigned int numThreads;
+
+    static void connectionThread(EvaluationServer *server, int fd) {
+        FILE *in = fdopen(fd, "r");
+        FILE *out = fdopen(dup(fd), "w");
+        if (in != NULL && out != NULL)
+            server->serve(in, out);
+        if (in != NULL)
+            fclose(in);
+        else
+            close(fd);
+        if (out != NULL)
+            fclose(out);
+    }
+
+public:
+    EvaluationServer(const int compareType, ParseRefFA *parseRefFA, const RegionSet *regions, const VariantCache *cache, const VCFParser *goldSet, const FuzzyMatcher *fuzzy, unsigned int numThreads)
+        : compareType(compareType), parseRefFA(parseRefFA), regions(regions), cache(cache), goldSet(goldSet), fuzzy(fuzzy), numThreads(numThreads) {}
+
+    // answer a request, false if a sample could not be parsed
+    bool evaluate(const std::vector<std::string> &samples, FILE *out) {
+        std::vector<VCFParser *> sampleSets;
+        for (size_t i=0; i<samples.size(); ++i)
+            sampleSets.push_back(new VCFParser(&goldSet->getContigs()));
+        VCFFileParser fileParser(compareType, parseRefFA, regions);
+        fileParser.setCache(cache);
+        bool ok = fileParser.parse(samples, sampleSets, numThreads);
+        if (!ok) {
+            fprintf(out, "Error - unable to parse file %s\n", samples[fileParser.failedFile()].c_str());
         }
-        printf("\n");
-        printf("PREC:");
-        for (int i=0; i<numSamples; ++i) {
-            printf(" %lf", (double)numTruePositives[i] / (double)sampleSetSize[i]);
+        else {
+            ReportOptions options = { numThreads, NULL, NULL, NULL, fuzzy, NULL, 0, false, NULL, 0, 0, false };
+            if (samples.size() == 1)
+                reportSample(out, options, *goldSet, *sampleSets[0], samples[0]);
+            else
+                reportROC(out, options, *goldSet, sampleSets, samples);
         }
-        printf("\n");
-        printf("RECALL:");
-        for (int i=0; i<numSamples; ++i) {
-            printf(" %lf", (double)numTruePositives[i] / (double)trueSetSize);
+        for (size_t i=0; i<sampleSets.size(); ++i)
+            delete sampleSets[i];
+        return ok;
+    }
+
+    // answer the requests read from in until its end or a line "quit"
+    void serve(FILE *in, FILE *out) {
+        char *line = NULL;
+        size_t lineSize = 0;
+        while (getline(&line, &lineSize, in) > 0) {
+            std::vector<std::string> samples;
+            char *saveptr;
+            for (char *token = strtok_r(line, " \t\r\n", &saveptr); token != NULL; token = strtok_r(NULL, " \t\r\n", &saveptr))
+                samples.push_back(token);
+            if (samples.empty())
+                continue;
+            if (samples.size() == 1 && samples[0] == "quit")
+                break;
+            evaluate(samples, out);
+            fprintf(out, "END\n");
+            if (fflush(out) != 0)
+                break;
         }
-        printf("\n");
-        printf("FSCORE:");
-        for (int i=0; i<numSamples; ++i) {
-            printf(" %lf", (double)(2*numTruePositives[i])/(double)(2*numTruePositives[i]+numFalsePositives[i]+numFalseNegatives[i]));
+        free(line);
+    }
+
+    // accept connections on a Unix socket at path, each served by its own thread. Only returns on error.
+    bool listen(const char *path) {
+        struct sockaddr_un addr;
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            errno = ENAMETOOLONG;
+            return false;
         }
-        printf("\n");
-        printf("CSV[AUC/PREC/RECALL/FSCORE]:");
-        for (int i=0; i<numSamples; ++i) {
-            printf(" %s=%lf,%lf,%lf,%lf", argv[i+4] ,AUC[i],(double)numTruePositives[i] / (double)sampleSetSize[i], (double)numTruePositives[i] / (double)trueSetSize, (double)(2*numTruePositives[i])/(double)(2*numTruePositives[i]+numFalsePositives[i]+numFalseNegatives[i]));
-        }
-        printf("\n");
-        for (std::set<unsigned int>::iterator iter = allSortedPos.begin(); iter != allSortedPos.end(); ++iter) {
-            // for each sample find the linearly interpolated position
-            unsigned int falsePositivePos = *iter;
-            printf("%lf", (double)falsePositivePos / (double)maxFalsePositives);
-            for (int i=0; i<numSamples; ++i) {
-                std::map<unsigned int, unsigned int>::iterator it = sortedSamples[i].lower_bound(falsePositivePos);
-                unsigned int foundFalsePos = it->first;
-                unsigned int foundTruePos = it->second;
-                if (foundFalsePos == falsePositivePos) {
-                    printf(" %lf", (double)foundTruePos/(double)numUnionPositiveVariants);
-                }
-                else { // interpolate with previous data entry
-                    --it;
-                    unsigned int prevFoundFalsePos = it->first;
-                    unsigned int prevFoundTruePos = it->second;
-                    double interp = ((double)(falsePositivePos - prevFoundFalsePos)) / ((double)(foundFalsePos - prevFoundFalsePos));
-                    double interpTruePos = interp * (double)foundTruePos + (1.0-interp) * (double)prevFoundTruePos;
-                    printf(" %lf", interpTruePos/(double)numUnionPositiveVariants);
-                }
-            }
-            printf("\n");
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+        unlink(path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(fd, 16) != 0) {
+            close(fd);
+            return false;
+        }
+        signal(SIGPIPE, SIG_IGN); // a client leaving ends its connection, not the server
+        while (true) {
+            int conn = accept(fd, NULL, NULL);
+            if (conn < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                break;
+            }
+            std::thread(connectionThread, this, conn).detach();
+        }
+        close(fd);
+        return false;
+    }
+};
+
+// Parameters of the synthetic data written by "genotypeMetrics bench", as name=value arguments
+struct BenchParameters {
+    uint64_t variants;     // gold set variants
+    unsigned int samples;  // sample VCFs, each a noisy subset of the gold set plus false positives
+    double indel;          // fraction of variants that are insertions or deletions, the rest SNPs
+    double multiallelic;   // fraction of sites with a second ALT allele
+    double noise;          // fraction of sample variants written padded with a neighbouring base
+    double recall;         // fraction of gold set sites in each sample
+    double falsePositives; // false positives per gold set site in each sample
+    double tpQual;         // mean QUAL of true positives, exponentially distributed
+    double fpQual;         // mean QUAL of false positives
+    unsigned int spacing;  // mean bases between gold set sites
+    uint64_t seed;
+
+    BenchParameters() : variants(0), samples(2), indel(0.15), multiallelic(0.02), noise(0.05), recall(0.9), falsePositives(0.1),
+                        tpQual(60), fpQual(20), spacing(40), seed(1) {}
+
+    // whether name=value names a parameter, whatever its value
+    static bool known(const char *arg) {
+        static const char *names[] = { "samples", "indel", "multiallelic", "noise", "recall", "fp", "tpqual", "fpqual", "spacing", "seed" };
+        const char *sep = strchr(arg, '=');
+        if (sep == NULL)
+            return false;
+        std::string name(arg, sep-arg);
+        for (size_t i=0; i<sizeof(names)/sizeof(names[0]); ++i) {
+            if (name == names[i])
+                return true;
+        }
+        return false;
+    }
+
+    // parses value as a number in [min, max] into *result, false if it is not one
+    static bool parseNumber(const char *value, double min, double max, double *result) {
+        char *end;
+        double number = strtod(value, &end);
+        if (end == value || *end != 0 || !(number >= min && number <= max))
+            return false;
+        *result = number;
+        return true;
+    }
+
+    // sets name=value, false if not a parameter or the value is out of its range
+    bool set(const char *arg) {
+        const char *sep = strchr(arg, '=');
+        if (sep == NULL)
+            return false;
+        std::string name(arg, sep-arg);
+        const char *value = sep+1;
+        double number;
+        if (name == "seed") {
+            char *end;
+            seed = strtoull(value, &end, 10);
+            return end != value && *end == 0;
+        }
+        if (name == "samples" && parseNumber(value, 1, 1e6, &number) && number == (unsigned int)number)
+            samples = number;
+        else if (name == "indel" && parseNumber(value, 0, 1, &number))
+            indel = number;
+        else if (name == "multiallelic" && parseNumber(value, 0, 1, &number))
+            multiallelic = number;
+        else if (name == "noise" && parseNumber(value, 0, 1, &number))
+            noise = number;
+        else if (name == "recall" && parseNumber(value, 0, 1, &number))
+            recall = number;
+        else if (name == "fp" && parseNumber(value, 0, 1, &number))
+            falsePositives = number;
+        else if (name == "tpqual" && parseNumber(value, 0, 1e6, &number))
+            tpQual = number;
+        else if (name == "fpqual" && parseNumber(value, 0, 1e6, &number))
+            fpQual = number;
+        else if (name == "spacing" && parseNumber(value, 2, 1e6, &number) && number == (unsigned int)number)
+            spacing = number;
+        else
+            return false;
+        return true;
+    }
+};
+
+#define BENCH_CONTIG_SIZE 50000000 // bases per synthetic contig at most
+#define BENCH_MAX_INDEL 20
+
+// Writes a synthetic reference with homopolymers and tandem repeats, a gold set VCF and sample
+// VCFs, all determined by the parameters including the seed
+class BenchGenerator {
+protected:
+    const BenchParameters &params;
+    uint64_t state;
+    std::string sequence; // of the contig being written
+    FILE *goldOut;
+    std::vector<FILE *> sampleOut;
+
+    // splitmix64
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // in [0, 1)
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    unsigned int below(unsigned int n) {
+        return next() % n;
+    }
+
+    char base() {
+        return "ACGT"[below(4)];
+    }
+
+    char otherBase(char b) {
+        char c;
+        do {
+            c = base();
+        } while (c == b);
+        return c;
+    }
+
+    // 1 + geometric with p 1/2, at most BENCH_MAX_INDEL
+    unsigned int indelLength() {
+        unsigned int len = 1;
+        while (len < BENCH_MAX_INDEL && (next() & 1))
+            ++len;
+        return len;
+    }
+
+    double qual(double mean) {
+        return -mean * log(1.0 - uniform());
+    }
+
+    void makeSequence(uint64_t length) {
+        sequence.clear();
+        sequence.reserve(length + BENCH_MAX_INDEL*16);
+        while (sequence.size() < length) {
+            unsigned int r = below(200);
+            if (r == 0) {
+                sequence.append(6 + below(15), base());
+            }
+            else if (r == 1) {
+                std::string unit;
+                for (unsigned int len = 2 + below(5); unit.size() < len; )
+                    unit += base();
+                for (unsigned int copies = 3 + below(13); copies > 0; --copies)
+                    sequence += unit;
+            }
+            else {
+                sequence += base();
+            }
+        }
+        sequence.resize(length);
+    }
+
+    bool writeFasta(FILE *out, const std::string &name) {
+        fprintf(out, ">%s\n", name.c_str());
+        for (size_t i=0; i<sequence.size(); i += 60) {
+            fwrite(sequence.data()+i, 1, std::min((size_t)60, sequence.size()-i), out);
+            fputc('\n', out);
+        }
+        return !ferror(out);
+    }
+
+    // the REF and ALT alleles of a site at 0-based pos, which must leave BENCH_MAX_INDEL+2 bases after it
+    void makeSite(uint64_t pos, std::string *ref, std::vector<std::string> *alts) {
+        alts->clear();
+        bool second = uniform() < params.multiallelic;
+        if (uniform() >= params.indel) {
+            *ref = sequence.substr(pos, 1);
+            alts->push_back(std::string(1, otherBase((*ref)[0])));
+            if (second) {
+                char b;
+                do {
+                    b = otherBase((*ref)[0]);
+                } while (b == (*alts)[0][0]);
+                alts->push_back(std::string(1, b));
+            }
+        }
+        else if (next() & 1) {
+            // deletion after the anchor base, the second allele deleting one base less
+            unsigned int len = indelLength();
+            *ref = sequence.substr(pos, len + 1 + second);
+            alts->push_back(ref->substr(0, 1));
+            if (second)
+                alts->push_back(ref->substr(0, 1) + (*ref)[len+1]);
+        }
+        else {
+            // insertion after the anchor base, the second allele inserting one more
+            *ref = sequence.substr(pos, 1);
+            std::string alt = *ref;
+            for (unsigned int len = indelLength(); len > 0; --len)
+                alt += base();
+            alts->push_back(alt);
+            if (second)
+                alts->push_back(alt + base());
+        }
+    }
+
+    void writeRecord(FILE *out, const std::string &chrom, uint64_t pos, const std::string &ref, const std::vector<std::string> &alts, double q) {
+        fprintf(out, "%s\t%" PRIu64 "\t.\t%s\t", chrom.c_str(), pos+1, ref.c_str());
+        for (size_t i=0; i<alts.size(); ++i)
+            fprintf(out, "%s%s", i ? "," : "", alts[i].c_str());
+        fprintf(out, "\t%.1f\tPASS\t.\tGT\t%s\n", q, alts.size() > 1 ? "1/2" : "0/1");
+    }
+
+    // writes the site to a sample, possibly padded with the base before or after it
+    void writeSampleRecord(FILE *out, const std::string &chrom, uint64_t pos, std::string ref, std::vector<std::string> alts) {
+        if (uniform() < params.noise) {
+            if (pos > 0 && (next() & 1)) {
+                --pos;
+                ref.insert(ref.begin(), sequence[pos]);
+                for (size_t i=0; i<alts.size(); ++i)
+                    alts[i].insert(alts[i].begin(), sequence[pos]);
+            }
+            else {
+                char pad = sequence[pos + ref.size()];
+                ref += pad;
+                for (size_t i=0; i<alts.size(); ++i)
+                    alts[i] += pad;
+            }
+        }
+        writeRecord(out, chrom, pos, ref, alts, qual(params.tpQual));
+    }
+
+    // the sites of a contig, each sample's false positives in the gap after each site
+    void writeVariants(const std::string &chrom, uint64_t numSites) {
+        uint64_t pos = 1 + below(params.spacing);
+        std::string ref;
+        std::vector<std::string> alts;
+        for (uint64_t i=0; i<numSites; ++i) {
+            makeSite(pos, &ref, &alts);
+            writeRecord(goldOut, chrom, pos, ref, alts, params.tpQual);
+            uint64_t gap = 2 + below(2*params.spacing);
+            uint64_t end = pos + ref.size() + 1; // the base after may pad the site
+            for (unsigned int j=0; j<params.samples; ++j) {
+                if (uniform() < params.recall)
+                    writeSampleRecord(sampleOut[j], chrom, pos, ref, alts);
+                if (uniform() < params.falsePositives) {
+                    uint64_t fpPos = end + gap/2;
+                    std::vector<std::string> fpAlts(1, std::string(1, otherBase(sequence[fpPos])));
+                    writeRecord(sampleOut[j], chrom, fpPos, sequence.substr(fpPos, 1), fpAlts, qual(params.fpQual));
+                }
+            }
+            pos = end + gap + 1;
+        }
+    }
+
+public:
+    BenchGenerator(const BenchParameters &params) : params(params), state(params.seed), goldOut(NULL) {}
+
+    // writes ref.fa, gold.vcf and sample1.vcf... to directory, false if a file could not be written
+    bool write(const std::string &directory, std::string *failedFile) {
+        // sites take up to spacing + BENCH_MAX_INDEL + 5 bases each
+        uint64_t siteBases = params.spacing + BENCH_MAX_INDEL + 5;
+        uint64_t sitesPerContig = BENCH_CONTIG_SIZE / siteBases;
+        unsigned int numContigs = (params.variants + sitesPerContig - 1) / sitesPerContig;
+        if (numContigs == 0)
+            numContigs = 1;
+
+        std::vector<std::string> names;
+        names.push_back(directory + "/ref.fa");
+        names.push_back(directory + "/gold.vcf");
+        for (unsigned int j=0; j<params.samples; ++j) {
+            char name[32];
+            snprintf(name, sizeof(name), "/sample%u.vcf", j+1);
+            names.push_back(directory + name);
+        }
+        // the .fai of an earlier reference would no longer match
+        unlink((names[0] + ".fai").c_str());
+        std::vector<FILE *> files;
+        bool ok = true;
+        for (size_t i=0; i<names.size() && ok; ++i) {
+            FILE *file = fopen(names[i].c_str(), "w");
+            if (file == NULL) {
+                *failedFile = names[i];
+                ok = false;
+            }
+            else {
+                files.push_back(file);
+            }
+        }
+        if (ok) {
+            goldOut = files[1];
+            sampleOut.assign(files.begin()+2, files.end());
+            for (size_t i=1; i<files.size(); ++i) {
+                fprintf(files[i], "##fileformat=VCFv4.2\n");
+                for (unsigned int c=0; c<numContigs; ++c)
+                    fprintf(files[i], "##contig=<ID=chr%u>\n", c+1);
+                fprintf(files[i], "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSAMPLE\n");
+            }
+            uint64_t remaining = params.variants;
+            for (unsigned int c=0; c<numContigs; ++c) {
+                uint64_t numSites = remaining / (numContigs - c);
+                remaining -= numSites;
+                char chrom[32];
+                snprintf(chrom, sizeof(chrom), "chr%u", c+1);
+                makeSequence(numSites * siteBases + 1000);
+                if (!writeFasta(files[0], chrom)) {
+                    *failedFile = names[0];
+                    ok = false;
+                    break;
+                }
+                writeVariants(chrom, numSites);
+            }
+        }
+        for (size_t i=0; i<files.size(); ++i) {
+            if ((ferror(files[i]) || fclose(files[i]) != 0) && ok) {
+                *failedFile = names[i];
+                ok = false;
+            }
+        }
+        sequence.clear();
+        return ok;
+    }
+};
+
+// "genotypeMetrics bench [directory] [variants,...] [name=value ...]": for each number of variants
+// writes synthetic data to directory, evaluates it with all samples as a ROC comparison and prints
+// the profile of the run as a line of JSON
+int runBench(int argc, char *argv[], unsigned int numThreads) {
+    std::string directory = argv[2];
+    std::vector<uint64_t> sizes;
+    BenchParameters params;
+    const char *list = (argc > 3 && strchr(argv[3], '=') == NULL) ? argv[3] : "10000,100000,1000000";
+    for (const char *p = list; *p != 0; ) {
+        char *end;
+        uint64_t size = strtoull(p, &end, 10);
+        if (end == p || size == 0) {
+            printf("Error - invalid number of variants %s\n", list);
+            return -1;
+        }
+        sizes.push_back(size);
+        p = (*end == ',') ? end+1 : end;
+    }
+    for (int i = (list == argv[3]) ? 4 : 3; i<argc; ++i) {
+        if (!params.set(argv[i])) {
+            if (BenchParameters::known(argv[i]))
+                printf("Error - invalid value of bench parameter %s\n", argv[i]);
+            else
+                printf("Error - unknown bench parameter %s\n", argv[i]);
+            return -1;
+        }
+    }
+    mkdir(directory.c_str(), 0777);
+
+    for (size_t s=0; s<sizes.size(); ++s) {
+        params.variants = sizes[s];
+        BenchGenerator generator(params);
+        std::string failedFile;
+        double start = wallSeconds();
+        if (!generator.write(directory, &failedFile)) {
+            printf("Error writing file %s: %s\n", failedFile.c_str(), strerror(errno));
+            return -1;
+        }
+        Profile profile;
+        profile.add("variants", params.variants);
+        profile.add("samples", (uint64_t)params.samples);
+        profile.add("threads", (uint64_t)numThreads);
+        profile.add("indel", params.indel);
+        profile.add("multiallelic", params.multiallelic);
+        profile.add("noise", params.noise);
+        profile.add("seed", params.seed);
+        profile.add("generate_seconds", wallSeconds() - start);
+
+        profile.begin("reference_load");
+        ParseRefFA refFile;
+        std::string refName = directory + "/ref.fa";
+        if (!refFile.readFile(refName.c_str())) {
+            printf("Error reading file %s: %s\n", refName.c_str(), strerror(errno));
+            return -1;
+        }
+        ContigDictionary contigs;
+        contigs.addReference(&refFile);
+
+        profile.begin("parse");
+        std::vector<std::string> filenames(1, directory + "/gold.vcf");
+        VCFParser goldSet(&contigs);
+        std::vector<VCFParser *> parsers(1, &goldSet);
+        std::vector<VCFParser *> sampleSets;
+        std::vector<std::string> names;
+        for (unsigned int j=0; j<params.samples; ++j) {
+            char name[32];
+            snprintf(name, sizeof(name), "/sample%u.vcf", j+1);
+            filenames.push_back(directory + name);
+            names.push_back(filenames.back());
+            sampleSets.push_back(new VCFParser(&contigs));
+        }
+        parsers.insert(parsers.end(), sampleSets.begin(), sampleSets.end());
+        VCFFileParser fileParser(COMPARE_ALL, &refFile);
+        fileParser.setProfile(&profile);
+        bool ok = fileParser.parse(filenames, parsers, numThreads);
+        profile.end();
+        if (!ok) {
+            printf("Error - unable to parse file %s\n", filenames[fileParser.failedFile()].c_str());
+        }
+        else {
+            // the metrics themselves are not wanted, only the time taken to work them out
+            FILE *out = fopen("/dev/null", "w");
+            ReportOptions options = { numThreads, NULL, NULL, NULL, NULL, &profile, 0, false, NULL, 0, 0, false };
+            if (params.samples == 1)
+                ok = reportSample(out, options, goldSet, *sampleSets[0], names[0]);
+            else
+                ok = reportROC(out, options, goldSet, sampleSets, names);
+            fclose(out);
+            profile.write(stdout);
+            fflush(stdout);
+        }
+        for (unsigned int j=0; j<params.samples; ++j)
+            delete sampleSets[j];
+        if (!ok)
+            return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    ParseRefFA *refFile = NULL;
+    ContigDictionary contigs;
+    unsigned int numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0)
+        numThreads = 1;
+    RegionSet *regions = NULL;
+    const char *regionsFile = NULL;
+    VariantCache *cache = NULL;
+    const char *cacheDir = NULL;
+    const char *prFile = NULL;
+    Stratifier *stratifier = NULL;
+    const char *strataFile = NULL;
+    std::vector<const char *> strataBeds;
+    FILE *strataOut = NULL;
+    bool stream = false;
+    FuzzyMatcher *fuzzy = NULL;
+    int fuzzyWindow = -1;
+    Profile profile;
+    bool profiling = false;
+    const char *externalDir = NULL;
+    uint64_t memoryBudget = 1024;
+    unsigned int rocPoints = 0;
+    bool rocJSON = false;
+    const char *rocBinary = NULL;
+    unsigned int bootstrapReplicates = 0;
+    uint64_t bootstrapBlock = BOOTSTRAP_BLOCK_SIZE;
+    bool multiSample = false;
+    bool prMetrics = false;
+    uint64_t cacheSize = VARIANT_CACHE_SIZE;
+    unsigned int numTruthSets = 0;
+    // options may be given anywhere, the remaining arguments are positional
+    int numArgs = 1;
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0 && i+1 < argc && atoi(argv[i+1]) > 0)
+            numThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--regions") == 0 && i+1 < argc)
+            regionsFile = argv[++i];
+        else if (strcmp(argv[i], "--cache") == 0 && i+1 < argc)
+            cacheDir = argv[++i];
+        else if (strcmp(argv[i], "--cache-size") == 0 && i+1 < argc && atoi(argv[i+1]) > 0)
+            cacheSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pr") == 0 && i+1 < argc)
+            prFile = argv[++i];
+        else if (strcmp(argv[i], "--strata") == 0 && i+1 < argc)
+            strataFile = argv[++i];
+        else if (strcmp(argv[i], "--strata-bed") == 0 && i+1 < argc)
+            strataBeds.push_back(argv[++i]);
+        else if (strcmp(argv[i], "--stream") == 0)
+            stream = true;
+        else if (strcmp(argv[i], "--fuzzy") == 0 && i+1 < argc && atoi(argv[i+1]) >= 0)
+            fuzzyWindow = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--profile") == 0)
+            profiling = true;
+        else if (strcmp(argv[i], "--external") == 0 && i+1 < argc)
+            externalDir = argv[++i];
+        else if (strcmp(argv[i], "--memory") == 0 && i+1 < argc && atoi(argv[i+1]) > 0)
+            memoryBudget = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--roc-points") == 0 && i+1 < argc && atoi(argv[i+1]) > 1)
+            rocPoints = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--roc-json") == 0)
+            rocJSON = true;
+        else if (strcmp(argv[i], "--roc-binary") == 0 && i+1 < argc)
+            rocBinary = argv[++i];
+        else if (strcmp(argv[i], "--bootstrap") == 0 && i+1 < argc && atoi(argv[i+1]) > 0)
+            bootstrapReplicates = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bootstrap-block") == 0 && i+1 < argc && atoi(argv[i+1]) > 0)
+            bootstrapBlock = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--multi-sample") == 0)
+            multiSample = true;
+        else if (strcmp(argv[i], "--pr-metrics") == 0)
+            prMetrics = true;
+        else if (strcmp(argv[i], "--matrix") == 0) {
+            // otherwise the count would be taken as the comparison type
+            if (i+1 == argc || atoi(argv[i+1]) <= 0) {
+                printf("Error - --matrix needs the number of truth sets, 1 or more\n");
+                return -1;
+            }
+            numTruthSets = atoi(argv[++i]);
+        }
+        else
+            argv[numArgs++] = argv[i];
+    }
+    argc = numArgs;
+    bool serve = (argc > 1 && strcmp(argv[1], "serve") == 0);
+    if (serve) {
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    // requests are answered on stdout or the socket only, checked before any output file is created
+    if (serve && (prFile != NULL || strataFile != NULL || prMetrics || rocPoints > 0 || rocJSON || rocBinary != NULL)) {
+        printf("Error - serve answers each request with its metrics only and cannot be used with --pr, --strata, --pr-metrics,\n"
+               "        --roc-points, --roc-json or --roc-binary\n");
+        return -1;
+    }
+    if (serve && stream) {
+        printf("Error - serve reads the samples of each request into memory and cannot be used with --stream\n");
+        return -1;
+    }
+    if (argc == 4 && strcmp(argv[1], "packref") == 0) {
+        ParseRefFA fasta;
+        if (!fasta.readFile(argv[2])) {
+            printf("Error reading file %s: %s\n", argv[2], strerror(errno));
+            return -1;
+        }
+        if (!fasta.writeImage(argv[3])) {
+            printf("Error writing file %s: %s\n", argv[3], strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+    if (!serve && argc >= 3 && strcmp(argv[1], "bench") == 0)
+        return runBench(argc, argv, numThreads);
+    if (argc < (serve ? 4 : 5) || (serve && argc > 5)) {
+        goto failed;
+    }
+    int compareType;
+    if (strcmp(argv[1], "snp") == 0) {
+        compareType = COMPARE_SNP;
+    }
+    else if (strcmp(argv[1], "indel") == 0) {
+        compareType = COMPARE_INDEL;
+    }
+    else if (strcmp(argv[1], "all") == 0) {
+        compareType = COMPARE_ALL;
+    }
+    else {
+        goto failed;
+    }
+
+    // read fa file
+    if (strcmp(argv[2], "none") != 0) {
+        if (profiling)
+            profile.begin("reference_load");
+        refFile = new ParseRefFA();
+        if (!refFile->readFile(argv[2])) {
+            printf("Error reading file %s: %s\n", argv[2], strerror(errno));
+            goto errfailed;
+        }
+        if (profiling)
+            profile.end();
+        contigs.addReference(refFile);
+    }
+    // contigs declared by the VCFs, a VCF that cannot be read is reported when parsed
+    for (int i=3; i<(serve ? 4 : argc); ++i)
+        contigs.addVCFHeader(argv[i]);
+    if (contigs.size() == 0)
+        contigs.addHuman();
+
+    if (regionsFile != NULL) {
+        regions = new RegionSet();
+        if (!regions->read(regionsFile)) {
+            printf("Error reading file %s: %s\n", regionsFile, strerror(errno));
+            goto errfailed;
+        }
+        regions->index(contigs);
+    }
+    if (strataFile != NULL) {
+        stratifier = new Stratifier(&contigs);
+        for (size_t i=0; i<strataBeds.size(); ++i) {
+            // name=regions.bed, or the file name as the name
+            const char *sep = strchr(strataBeds[i], '=');
+            std::string name = (sep == NULL) ? strataBeds[i] : std::string(strataBeds[i], sep-strataBeds[i]);
+            const char *bedFile = (sep == NULL) ? strataBeds[i] : sep+1;
+            if (!stratifier->addBed(name, bedFile)) {
+                printf("Error reading file %s: %s\n", bedFile, strerror(errno));
+                goto errfailed;
+            }
+        }
+        strataOut = fopen(strataFile, "w");
+        if (strataOut == NULL) {
+            printf("Error writing file %s: %s\n", strataFile, strerror(errno));
+            goto errfailed;
+        }
+        fprintf(strataOut, "#sample\tstratum\tvalue\ttp\tfp\tfn\tprecision\trecall\tfscore\n");
+    }
+    if (fuzzyWindow >= 0) {
+        if (refFile == NULL) {
+            printf("Error - --fuzzy compares haplotypes built from the reference, which must be given\n");
+            goto errfailed;
+        }
+        fuzzy = new FuzzyMatcher(refFile, &contigs, fuzzyWindow);
+    }
+    if (cacheDir != NULL) {
+        cache = new VariantCache(cacheDir, compareType, refFile ? refFile->identity() : 0, &contigs, regions ? regions->identity(contigs) : 0, cacheSize << 20);
+        if (!cache->openDirectory()) {
+            printf("Error - unable to use cache directory %s: %s\n", cacheDir, strerror(errno));
+            goto errfailed;
+        }
+    }
+
+    if (bootstrapReplicates > 0 && (serve || stream || externalDir != NULL || rocJSON)) {
+        printf("Error - --bootstrap needs all variants in memory and text output, so cannot be used with serve, --stream, --external or --roc-json\n");
+        goto errfailed;
+    }
+    if (rocJSON && rocBinary != NULL) {
+        printf("Error - --roc-json prints the ROC plot with the metrics and cannot be used with --roc-binary\n");
+        goto errfailed;
+    }
+    // a single sample is reported as precision, recall and F-score, without a ROC plot
+    if (numTruthSets == 0 && !multiSample && argc == 5 && (prMetrics || rocPoints > 0 || rocJSON || rocBinary != NULL)) {
+        printf("Error - --pr-metrics, --roc-points, --roc-json and --roc-binary need two or more samples or --multi-sample\n");
+        goto errfailed;
+    }
+    if (numTruthSets > 0) {
+        if (serve || stream || externalDir != NULL || multiSample || bootstrapReplicates > 0 || stratifier != NULL || prFile != NULL || rocPoints > 0 || rocBinary != NULL) {
+            printf("Error - --matrix prints tables of metrics only and cannot be used with serve, --stream, --external, --multi-sample,\n"
+                   "        --bootstrap, --strata, --pr, --roc-points or --roc-binary\n");
+            goto errfailed;
+        }
+        if (argc < 4 + (int)numTruthSets) {
+            printf("Error - --matrix %u needs %u truth set VCFs followed by at least one sample VCF\n", numTruthSets, numTruthSets);
+            goto errfailed;
+        }
+        // every truth set and sample is parsed once, together, then each pair matched
+        std::vector<VCFParser *> parsers;
+        for (int i=3; i<argc; ++i)
+            parsers.push_back(new VCFParser(&contigs));
+        VCFFileParser fileParser(compareType, refFile, regions);
+        fileParser.setCache(cache);
+        if (profiling) {
+            fileParser.setProfile(&profile);
+            profile.begin("parse");
+        }
+        bool parsed = fileParser.parse(std::vector<std::string>(argv+3, argv+argc), parsers, numThreads);
+        if (!parsed)
+            printf("Error - unable to parse file %s\n", argv[3+fileParser.failedFile()]);
+        if (profiling)
+            profile.end();
+        ReportOptions options = { numThreads, NULL, NULL, NULL, fuzzy, profiling ? &profile : NULL, 0, rocJSON, NULL, 0, 0, false };
+        std::vector<VCFParser *> truthSets(parsers.begin(), parsers.begin() + numTruthSets);
+        std::vector<VCFParser *> sampleSets(parsers.begin() + numTruthSets, parsers.end());
+        if (parsed && !reportMatrix(stdout, options, truthSets, sampleSets, std::vector<std::string>(argv+3, argv+3+numTruthSets), std::vector<std::string>(argv+3+numTruthSets, argv+argc)))
+            parsed = false;
+        for (size_t i=0; i<parsers.size(); ++i)
+            delete parsers[i];
+        if (!parsed)
+            goto errfailed;
+        if (profiling && fuzzy != NULL)
+            profile.add("fuzzy_limited_clusters", fuzzy->numLimitedClusters());
+        if (profiling)
+            profile.write(stderr);
+        return 0;
+    }
+    if (multiSample) {
+        if (serve || stream || externalDir != NULL || bootstrapReplicates > 0 || cacheDir != NULL) {
+            printf("Error - --multi-sample cannot be used with serve, --stream, --external, --bootstrap or --cache\n");
+            goto errfailed;
+        }
+        if (argc != 5) {
+            printf("Error - --multi-sample evaluates the sample columns of a single sample VCF\n");
+            goto errfailed;
+        }
+        ReportOptions options = { numThreads, prFile, stratifier, strataOut, fuzzy, profiling ? &profile : NULL, rocPoints, rocJSON, rocBinary, 0, 0, prMetrics };
+        if (!reportMultiSample(stdout, options, &contigs, argv[3], argv[4], compareType, refFile, regions))
+            goto errfailed;
+        if (profiling && fuzzy != NULL)
+            profile.add("fuzzy_limited_clusters", fuzzy->numLimitedClusters());
+        if (profiling)
+            profile.write(stderr);
+        if (stratifier != NULL) {
+            fclose(strataOut);
+            delete stratifier;
+        }
+        return 0;
+    }
+    if (externalDir != NULL) {
+        if (serve || stream || stratifier != NULL || fuzzy != NULL || cacheDir != NULL) {
+            printf("Error - --external cannot be used with serve, --stream, --strata, --fuzzy or --cache\n");
+            goto errfailed;
+        }
+        ReportOptions options = { numThreads, prFile, NULL, NULL, NULL, profiling ? &profile : NULL, rocPoints, rocJSON, rocBinary, 0, 0, prMetrics };
+        if (!reportExternal(stdout, options, &contigs, std::vector<std::string>(argv+3, argv+argc), compareType, refFile, regions, externalDir, memoryBudget << 20))
+            goto errfailed;
+        if (profiling)
+            profile.write(stderr);
+        return 0;
+    }
+    if (serve) {
+        VCFParser goldSet(&contigs);
+        VCFFileParser fileParser(compareType, refFile, regions);
+        fileParser.setCache(cache);
+        if (profiling) {
+            fileParser.setProfile(&profile);
+            profile.begin("parse");
+        }
+        if (!fileParser.parse(std::vector<std::string>(1, argv[3]), std::vector<VCFParser *>(1, &goldSet), numThreads)) {
+            printf("Error - unable to parse file %s\n", argv[3]);
+            goto errfailed;
+        }
+        if (profiling)
+            profile.end();
+        // only loading is profiled, before the requests
+        if (profiling)
+            profile.write(stderr);
+        EvaluationServer server(compareType, refFile, regions, cache, &goldSet, fuzzy, numThreads);
+        if (argc == 4) {
+            server.serve(stdin, stdout);
+        }
+        else if (!server.listen(argv[4])) {
+            printf("Error listening on socket %s: %s\n", argv[4], strerror(errno));
+            goto errfailed;
+        }
+        return 0;
+    }
+    if (stream) {
+        if (stratifier != NULL || fuzzy != NULL) {
+            printf("Error - --strata and --fuzzy need all variants of each sample and cannot be used with --stream\n");
+            goto errfailed;
+        }
+        VCFParser goldSet(&contigs);
+        VCFFileParser fileParser(compareType, refFile, regions);
+        fileParser.setCache(cache);
+        if (profiling) {
+            fileParser.setProfile(&profile);
+            profile.begin("parse");
+        }
+        if (!fileParser.parse(std::vector<std::string>(1, argv[3]), std::vector<VCFParser *>(1, &goldSet), numThreads)) {
+            printf("Error - unable to parse file %s\n", argv[3]);
+            goto errfailed;
+        }
+        if (profiling)
+            profile.end();
+        ReportOptions options = { numThreads, prFile, NULL, NULL, NULL, NULL, rocPoints, rocJSON, rocBinary, 0, 0, prMetrics };
+        if (profiling)
+            profile.begin("stream");
+        if (!reportStream(stdout, options, goldSet, std::vector<std::string>(argv+4, argv+argc), compareType, refFile, regions))
+            goto errfailed;
+        if (profiling) {
+            profile.end();
+            profile.write(stderr);
+        }
+        return 0;
+    }
+    if (argc == 5) {
+        VCFParser goldSet(&contigs), sampleSet(&contigs);
+        std::vector<VCFParser *> parsers;
+        parsers.push_back(&goldSet);
+        parsers.push_back(&sampleSet);
+        VCFFileParser fileParser(compareType, refFile, regions);
+        fileParser.setCache(cache);
+        if (profiling) {
+            fileParser.setProfile(&profile);
+            profile.begin("parse");
+        }
+        if (!fileParser.parse(std::vector<std::string>(argv+3, argv+5), parsers, numThreads)) {
+            printf("Error - unable to parse file %s\n", argv[3+fileParser.failedFile()]);
+            goto errfailed;
+        }
+        if (profiling)
+            profile.end();
+        ReportOptions options = { numThreads, prFile, stratifier, strataOut, fuzzy, profiling ? &profile : NULL, rocPoints, rocJSON, rocBinary, bootstrapReplicates, bootstrapBlock, prMetrics };
+        if (!reportSample(stdout, options, goldSet, sampleSet, argv[4]))
+            goto errfailed;
+        if (profiling && fuzzy != NULL)
+            profile.add("fuzzy_limited_clusters", fuzzy->numLimitedClusters());
+        if (profiling)
+            profile.write(stderr);
+        if (stratifier != NULL) {
+            fclose(strataOut);
+            delete stratifier;
+        }
+        return 0;
+    }
+    if (argc > 5) {
+        VCFParser goldSet(&contigs);
+        std::vector<VCFParser *> sampleSets;
+        unsigned int numSamples = argc-4;
+        for (unsigned int i=0; i<numSamples; ++i)
+            sampleSets.push_back(new VCFParser(&contigs));
+
+        // the gold set and all samples are parsed together, then the samples matched in parallel
+        std::vector<VCFParser *> parsers(1, &goldSet);
+        parsers.insert(parsers.end(), sampleSets.begin(), sampleSets.end());
+        VCFFileParser fileParser(compareType, refFile, regions);
+        fileParser.setCache(cache);
+        if (profiling) {
+            fileParser.setProfile(&profile);
+            profile.begin("parse");
+        }
+        if (!fileParser.parse(std::vector<std::string>(argv+3, argv+argc), parsers, numThreads)) {
+            printf("Error - unable to parse file %s\n", argv[3+fileParser.failedFile()]);
+            goto errfailed;
+        }
+        if (profiling)
+            profile.end();
+        ReportOptions options = { numThreads, prFile, stratifier, strataOut, fuzzy, profiling ? &profile : NULL, rocPoints, rocJSON, rocBinary, bootstrapReplicates, bootstrapBlock, prMetrics };
+        if (!reportROC(stdout, options, goldSet, sampleSets, std::vector<std::string>(argv+4, argv+argc)))
+            goto errfailed;
+        if (profiling && fuzzy != NULL)
+            profile.add("fuzzy_limited_clusters", fuzzy->numLimitedClusters());
+        if (profiling)
+            profile.write(stderr);
+        if (stratifier != NULL) {
+            fclose(strataOut);
+            delete stratifier;
         }
         for (int i=0; i<numSamples; ++i) {
             delete sampleSets[i];
@@ -635,6 +5784,30 @@ int main(int argc, char *argv[]) {
 failed:;
     printf("Calculate Precision, Recall, F-score:\n\%s [all | snp | indel] [reference.fa | none] [goldset.vcf] [sample.vcf]\n\n", argv[0]);
     printf("Calculate ROC AUC plot:\n\%s [all | snp | indel] [reference.fa | none] [goldset.vcf] [[sample1.vcf] [sample2.vcf] ...]\n\n", argv[0]);
+    printf("Calculate tables of AUC, precision, recall, F-score and AUC_PR of every sample against every truth set:\n\%s --matrix [M] [all | snp | indel] [reference.fa | none] [truth1.vcf ... truthM.vcf] [[sample1.vcf] ...]\n\n", argv[0]);
+    printf("Options: -t [threads] to parse and evaluate with, by default one per CPU\n");
+    printf("         --regions [regions.bed] to evaluate only variants overlapping the regions\n");
+    printf("         --cache [directory] to keep the normalised variants of each VCF for later runs\n");
+    printf("         --cache-size [MB] of entries kept in the --cache directory, the least recently used removed beyond, 4096 by default\n");
+    printf("         --pr [file] to write the precision-recall curve of each sample\n");
+    printf("         --strata [file] to write precision, recall and F-score by chromosome, variant class, indel length and QUAL\n");
+    printf("         --strata-bed [name=regions.bed] to add the variants overlapping the regions as a stratum, may be repeated\n");
+    printf("         --stream to evaluate position-sorted samples as they are read, with memory for the gold set only\n");
+    printf("         --fuzzy [window] to also match variants within window bases whose haplotypes are the same as the gold set's\n");
+    printf("         --pr-metrics to also print the area under the precision-recall curve and best F-score of each sample\n");
+    printf("         --roc-points [K] to print the ROC plot at K evenly spaced false positive rates, the AUC is of the whole curve\n");
+    printf("         --roc-json to print the ROC metrics and plot with the sample names as JSON\n");
+    printf("         --roc-binary [file] to write the ROC plot as float arrays instead of printing it\n");
+    printf("         --bootstrap [replicates] to print 95%% intervals of the metrics and their differences between samples by block bootstrap\n");
+    printf("         --bootstrap-block [bases] of the genomic blocks resampled by --bootstrap, 1000000 by default\n");
+    printf("         --multi-sample to evaluate every sample column of the sample VCF in one parse, against the gold set's column\n");
+    printf("           of the same name if any or else all its variants, by GT and scored by GQ\n");
+    printf("         --external [directory] to evaluate VCFs larger than memory through sorted runs in temporary files in directory\n");
+    printf("         --memory [MB] of variants to sort in memory at a time with --external, 1024 by default\n");
+    printf("         --profile to write the time of each phase, variant counts, ignored contigs and memory as JSON to stderr\n\n");
+    printf("Evaluate samples against a gold set kept in memory, a line of sample VCFs per request on stdin or the socket:\n\%s serve [all | snp | indel] [reference.fa | none] [goldset.vcf] [socket]\n\n", argv[0]);
+    printf("Time each phase of evaluating synthetic data of each number of variants, written to directory, as lines of JSON:\n\%s bench [directory] [variants,...] [samples=2 indel=0.15 multiallelic=0.02 noise=0.05 recall=0.9 fp=0.1 tpqual=60 fpqual=20 spacing=40 seed=1]\n\n", argv[0]);
+    printf("Write a reference image for faster loading, to be given in place of reference.fa:\n\%s packref [reference.fa] [reference.gmref]\n\n", argv[0]);
     printf("Note: To correctly match indels, the reference fasta that the variant files are based on should be specified.\n");
     printf("      First column of ROC AUC plot is false-positive rate, other columns are true-positive rate in order of sample\n");
     printf("      First lines of plot have text describing Precision, Recall, F-score and ROC AUC numbers for each sample\n");
@@ -642,6 +5815,16 @@ failed:;
 errfailed:;
    if (refFile)
        delete refFile;
+   if (regions)
+       delete regions;
+   if (cache)
+       delete cache;
+   if (stratifier)
+       delete stratifier;
+   if (fuzzy)
+       delete fuzzy;
+   if (strataOut)
+       fclose(strataOut);
    return -1;
 }
 
@@ -30,68 +30,353 @@
 
  *
  * mergeq.cpp - Processes fastq or sam file and merges quality scores (separated by newline)
- * from stdin. The new fastq or sam file will be output in stdout.
+ * from stdin (or a qualities file). The new fastq or sam file will be output in stdout.
  */
 
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <zlib.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
 #include <string>
 
-enum SeqFileType { SAM, FASTQ };
+enum SeqFileType { SAM, FASTQ, BAM };
 
 using namespace std;
 
-bool endsWith(const string& base, const string& pattern) {
-    if (base.length() < pattern.length())
-        return false;
-    return (base.substr(base.length() - pattern.length()).compare(pattern) == 0);
+// Reads lines of a plain or gzip/bgzip compressed file, or of stdin when the path is "-".
+// The first line is read ahead on open so that the format can be detected from the content
+// rather than from the file extension.
+class SeqInput {
+protected:
+    gzFile file;
+    char head[65536];
+    bool hasHead;
+
+public:
+    SeqInput() {
+        file = NULL;
+        hasHead = false;
+    }
+
+    ~SeqInput() {
+        close();
+    }
+
+    bool open(const std::string &path) {
+        int fd = (path.compare("-") == 0) ? dup(STDIN_FILENO) : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        file = gzdopen(fd, "rb");
+        if (file == NULL) {
+            ::close(fd);
+            return false;
+        }
+        gzbuffer(file, 1024*1024);
+        hasHead = (gzgets(file, head, sizeof(head)) != NULL);
+        return true;
+    }
+
+    void close() {
+        if (file != NULL)
+            gzclose(file);
+        file = NULL;
+    }
+
+    // SAM header lines are '@' followed by a two letter record type and a tab (@HD, @SQ, @PG, ...)
+    // whereas FASTQ entries are '@' followed by the read name. Headerless SAM falls through to SAM.
+    SeqFileType fileType() const {
+        if (!hasHead)
+            return SAM;
+        if (memcmp(head, "BAM\1", 4) == 0)
+            return BAM;
+        if (head[0] != '@')
+            return SAM;
+        if (isupper(head[1]) && isalpha(head[2]) && head[3] == '\t')
+            return SAM;
+        return FASTQ;
+    }
+
+    char *gets(char *buf, int len) {
+        if (hasHead) {
+            hasHead = false;
+            snprintf(buf, len, "%s", head);
+            return buf;
+        }
+        return gzgets(file, buf, len);
+    }
+};
+
+#define CRC32C_POLY 0x82f63b78
+
+// CRC32C (Castagnoli) tables; hardware is set when the CPU has the SSE4.2 crc32 instruction
+struct CRC32CTables {
+    uint32_t table[256];
+    uint32_t x2n[32];   // x^(2^n) modulo the polynomial, for combining CRCs
+    bool hardware;
+
+    CRC32CTables() {
+        for (uint32_t i=0; i<256; ++i) {
+            uint32_t c = i;
+            for (int k=0; k<8; ++k)
+                c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+            table[i] = c;
+        }
+        uint32_t p = 1u << 30; // x^1
+        x2n[0] = p;
+        for (int n=1; n<32; ++n)
+            x2n[n] = p = multModP(p, p);
+#if defined(__x86_64__)
+        hardware = __builtin_cpu_supports("sse4.2");
+#else
+        hardware = false;
+#endif
+    }
+
+    // a*b modulo the polynomial, in the reflected bit order of the CRC
+    static uint32_t multModP(uint32_t a, uint32_t b) {
+        uint32_t m = 1u << 31, p = 0;
+        while (m != 0) {
+            if (a & m) {
+                p ^= b;
+                if ((a & (m - 1)) == 0)
+                    break;
+            }
+            m >>= 1;
+            b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+        }
+        return p;
+    }
+};
+
+const CRC32CTables &crc32cTables() {
+    static CRC32CTables tables;
+    return tables;
 }
 
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(uint32_t crc, const uint8_t *buf, size_t len) {
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        buf += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len-- > 0)
+        crc = _mm_crc32_u8(crc, *buf++);
+    return crc;
+}
+#endif
+
+// running CRC32C of buf appended to crc (start with 0), same convention as zlib's crc32()
+uint32_t crc32c(uint32_t crc, const char *buf, size_t len) {
+    const CRC32CTables &tables = crc32cTables();
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (tables.hardware)
+        return ~crc32cHardware(crc, (const uint8_t *)buf, len);
+#endif
+    const uint8_t *p = (const uint8_t *)buf;
+    while (len-- > 0)
+        crc = tables.table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// CRC32C of A followed by B, given the CRCs of both and the length of B
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t lenB) {
+    const CRC32CTables &tables = crc32cTables();
+    uint32_t p = 1u << 31; // x^0
+    unsigned int k = 3;    // lenB is in bytes, i.e. x^(8*lenB)
+    while (lenB != 0) {
+        if (lenB & 1)
+            p = CRC32CTables::multModP(tables.x2n[k & 31], p);
+        lenB >>= 1;
+        k++;
+    }
+    return CRC32CTables::multModP(p, crcA) ^ crcB;
+}
+
+// CRC32C digests of the non-quality content and of the quality scores, before and after
+// quantisation. The non-quality digests of input and output must match.
+struct QualDigest {
+    enum { INPUT_OTHER, OUTPUT_OTHER, INPUT_QUAL, OUTPUT_QUAL, NUM_STREAMS };
+    uint32_t crc[NUM_STREAMS];
+    uint64_t len[NUM_STREAMS];
+
+    QualDigest() {
+        for (int i=0; i<NUM_STREAMS; ++i) {
+            crc[i] = 0;
+            len[i] = 0;
+        }
+    }
+
+    void add(int stream, const char *buf, size_t bufLen) {
+        crc[stream] = crc32c(crc[stream], buf, bufLen);
+        len[stream] += bufLen;
+    }
+
+    // add a line of the input or output, of which qualLen characters at qualStr are quality scores
+    void addLine(bool output, const char *line, size_t lineLen, const char *qualStr, unsigned int qualLen) {
+        int other = output ? OUTPUT_OTHER : INPUT_OTHER;
+        if (qualLen == 0) {
+            add(other, line, lineLen);
+            return;
+        }
+        add(other, line, qualStr-line);
+        add(output ? OUTPUT_QUAL : INPUT_QUAL, qualStr, qualLen);
+        add(other, qualStr+qualLen, lineLen - (qualStr-line) - qualLen);
+    }
+
+    // append the digests of content that follows the content digested so far
+    void append(const QualDigest &X) {
+        for (int i=0; i<NUM_STREAMS; ++i) {
+            crc[i] = crc32cCombine(crc[i], X.crc[i], X.len[i]);
+            len[i] += X.len[i];
+        }
+    }
+
+    bool otherUnchanged() const {
+        return crc[INPUT_OTHER] == crc[OUTPUT_OTHER] && len[INPUT_OTHER] == len[OUTPUT_OTHER];
+    }
+
+    bool write(const std::string &path, const char *tool, const std::string &inputPath, const std::string &outputPath) const {
+        FILE *out = fopen(path.c_str(), "w");
+        if (out == NULL)
+            return false;
+        const char *names[NUM_STREAMS] = { "input_nonqual", "output_nonqual", "input_qual", "output_qual" };
+        fprintf(out, "# CRC32C digests written by %s\n", tool);
+        fprintf(out, "input\t%s\n", inputPath.c_str());
+        fprintf(out, "output\t%s\n", outputPath.c_str());
+        for (int i=0; i<NUM_STREAMS; ++i)
+            fprintf(out, "%s\t%08x\t%" PRIu64 "\n", names[i], crc[i], len[i]);
+        fprintf(out, "nonqual_unchanged\t%s\n", otherUnchanged() ? "YES" : "NO");
+        return fclose(out) == 0;
+    }
+};
+
+
+// write out a line that is not modified, adding it to both the input and output digests
+void writeLine(const char *line, FILE *out, QualDigest *digest) {
+    if (digest != NULL) {
+        size_t lineLen = strlen(line);
+        digest->addLine(false, line, lineLen, line, 0);
+        digest->addLine(true, line, lineLen, line, 0);
+    }
+    fputs(line, out);
+}
+
+// length of the quality string at the start of a FASTQ quality line
+unsigned int qualLength(const char *line) {
+    unsigned int idx=0;
+    while (!(line[idx] == '\0' || line[idx] == '\n'))
+        ++idx;
+    return idx;
+}
+
+void printHelp(const char *argv0) {
+    fprintf(stderr, "Usage: %s [filename | -] [-q qualities] [-d /path/to/digest/filename] (quality scores per line from stdin or qualities file) (merged result in stdout)\n", argv0);
+    fprintf(stderr, "       Input may be FASTQ or SAM, plain or gzip compressed; - reads from stdin\n");
+    fprintf(stderr, "       -d writes CRC32C digests of the non-quality content and of the quality scores of input and output\n");
+}
 
 int main(int argc, char *argv[]) {
     if (argc <2) {
-        fprintf(stderr, "Usage: %s [filename] (quality scores per line from stdin) (merged result in stdout)\n", argv[0]);
+        printHelp(argv[0]);
         return 0;
     }
+    // the input file then option and value pairs
+    if (argc % 2 != 0) {
+        printHelp(argv[0]);
+        return -1;
+    }
     std::string inputfilepath = argv[1];
-    SeqFileType inputfiletype = endsWith(inputfilepath, ".fastq") ? FASTQ : SAM;
 
-    FILE *in = fopen(argv[1], "r");
-    if (in == NULL) {
+    FILE *qin = stdin;
+    std::string digestPath;
+    for (int i=2; i<argc; i+=2) {
+        std::string cmdopt = argv[i];
+        if ((cmdopt.compare("-q") != 0 && cmdopt.compare("-d") != 0) || i+1 >= argc) {
+            fprintf(stderr, "Invalid command option: %s\n", cmdopt.c_str());
+            printHelp(argv[0]);
+            return -1;
+        }
+        if (cmdopt.compare("-d") == 0) {
+            digestPath = argv[i+1];
+            continue;
+        }
+        if (strcmp(argv[i+1], "-") != 0) {
+            qin = fopen(argv[i+1], "r");
+            if (qin == NULL) {
+                fprintf(stderr, "Unable to open qualities file: %s [%s]\n", argv[i+1], strerror(errno));
+                return -1;
+            }
+        }
+    }
+    if (inputfilepath.compare("-") == 0 && qin == stdin) {
+        fprintf(stderr, "Input file and quality scores cannot both be read from stdin\n");
+        return -1;
+    }
+
+    SeqInput in;
+    if (!in.open(inputfilepath)) {
         fprintf(stderr, "Unable to open input file: %s [%s]\n", argv[1], strerror(errno));
         return -1;
     }
+    SeqFileType inputfiletype = in.fileType();
+    if (inputfiletype == BAM) {
+        fprintf(stderr, "BAM input is not supported: %s - convert with 'samtools view -h' first\n", argv[1]);
+        return -1;
+    }
+    QualDigest digest;
+    QualDigest *lineDigest = digestPath.empty() ? NULL : &digest;
     char line[65536], line2[65536];
-    while (fgets(line, sizeof(line), in)) {
+    while (in.gets(line, sizeof(line))) {
         if (inputfiletype == FASTQ) {
             // write the first line to the output
-            fputs(line, stdout);
+            writeLine(line, stdout, lineDigest);
             // write the other two lines to the output
             for (int i = 0; i < 2; ++i) {
-                if (!fgets(line, sizeof(line), in)) {
-                    printf("Failed to read fastq entry: %s\n", line);
+                if (!in.gets(line, sizeof(line))) {
+                    fprintf(stderr, "Failed to read fastq entry: %s\n", line);
                     return -1;
                 }
-                fputs(line, stdout);
+                writeLine(line, stdout, lineDigest);
             }
             // retrieve the qscore line
-            if (!fgets(line, sizeof(line), in)) {
-                printf("Failed to read fastq entry: %s\n", line);
+            if (!in.gets(line, sizeof(line))) {
+                fprintf(stderr, "Failed to read fastq entry: %s\n", line);
                 return -1;
             }
-            if (!fgets(line, sizeof(line), stdin)) {
-                printf("Failed to read stdin fastq quality score entry\n");
+            if (lineDigest != NULL)
+                digest.addLine(false, line, strlen(line), line, qualLength(line));
+            if (!fgets(line, sizeof(line), qin)) {
+                fprintf(stderr, "Failed to read stdin fastq quality score entry\n");
             }
+            if (lineDigest != NULL)
+                digest.addLine(true, line, strlen(line), line, qualLength(line));
             // write out
             fputs(line, stdout);
             continue;
         }
 
         if (line[0] == '@') {
-            fputs(line, stdout);
+            writeLine(line, stdout, lineDigest);
             continue;
         }
+        char *qualStr = line;
+        unsigned int qualLen = 0;
         bool wasWhitespace = true;
         unsigned int colNum=0, colStartPos=0, pos=0;
         while (line[pos]!=0) {
@@ -99,10 +384,14 @@ int main(int argc, char *argv[]) {
             if (whitespace && !wasWhitespace) {
                 wasWhitespace = true;
                 if (colNum == 11) {
-                    if (!fgets(line2, sizeof(line2), stdin)) {
-                        printf("Failed to read stdin fastq quality score entry\n");
+                    if (!fgets(line2, sizeof(line2), qin)) {
+                        fprintf(stderr, "Failed to read stdin fastq quality score entry\n");
                         return -1;
                     }
+                    qualStr = line+colStartPos;
+                    qualLen = pos-colStartPos;
+                    if (lineDigest != NULL)
+                        digest.addLine(false, line, strlen(line), qualStr, qualLen);
                     for (unsigned int idx=colStartPos; idx<pos; ++idx)
                         line[idx] = line2[idx-colStartPos];
                 }
@@ -114,7 +403,22 @@ int main(int argc, char *argv[]) {
             }
             pos++;
         }
+        if (lineDigest != NULL) {
+            if (qualLen == 0)
+                digest.addLine(false, line, strlen(line), line, 0);
+            digest.addLine(true, line, strlen(line), qualStr, qualLen);
+        }
         fputs(line, stdout);
     }
+    if (lineDigest != NULL) {
+        if (!digest.write(digestPath, "mergeq", inputfilepath, "-")) {
+            fprintf(stderr, "Unable to write digest file: %s [%s]\n", digestPath.c_str(), strerror(errno));
+            return -1;
+        }
+        if (!digest.otherUnchanged()) {
+            fprintf(stderr, "Non-quality content differs between input and output: %s\n", inputfilepath.c_str());
+            return -1;
+        }
+    }
     return 0;
 }
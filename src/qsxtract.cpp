@@ -35,43 +35,102 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
 #include <string>
 
-enum SeqFileType { SAM, FASTQ };
+enum SeqFileType { SAM, FASTQ, BAM };
 
 using namespace std;
 
-bool endsWith(const string& base, const string& pattern) {
-    if (base.length() < pattern.length())
-        return false;
-    return (base.substr(base.length() - pattern.length()).compare(pattern) == 0);
-}
+// Reads lines of a plain or gzip/bgzip compressed file, or of stdin when the path is "-".
+// The first line is read ahead on open so that the format can be detected from the content
+// rather than from the file extension.
+class SeqInput {
+protected:
+    gzFile file;
+    char head[65536];
+    bool hasHead;
+
+public:
+    SeqInput() {
+        file = NULL;
+        hasHead = false;
+    }
+
+    ~SeqInput() {
+        close();
+    }
+
+    bool open(const std::string &path) {
+        int fd = (path.compare("-") == 0) ? dup(STDIN_FILENO) : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        file = gzdopen(fd, "rb");
+        if (file == NULL) {
+            ::close(fd);
+            return false;
+        }
+        gzbuffer(file, 1024*1024);
+        hasHead = (gzgets(file, head, sizeof(head)) != NULL);
+        return true;
+    }
+
+    void close() {
+        if (file != NULL)
+            gzclose(file);
+        file = NULL;
+    }
+
+    // SAM header lines are '@' followed by a two letter record type and a tab (@HD, @SQ, @PG, ...)
+    // whereas FASTQ entries are '@' followed by the read name. Headerless SAM falls through to SAM.
+    SeqFileType fileType() const {
+        if (!hasHead)
+            return SAM;
+        if (memcmp(head, "BAM\1", 4) == 0)
+            return BAM;
+        if (head[0] != '@')
+            return SAM;
+        if (isupper(head[1]) && isalpha(head[2]) && head[3] == '\t')
+            return SAM;
+        return FASTQ;
+    }
+
+    char *gets(char *buf, int len) {
+        if (hasHead) {
+            hasHead = false;
+            snprintf(buf, len, "%s", head);
+            return buf;
+        }
+        return gzgets(file, buf, len);
+    }
+};
 
 void reportHelp(const char* argv0) {
     fprintf(stderr, "Usage: %s /path/to/filename|- [-o /path/to/output/filename]\n", argv0);
+    fprintf(stderr, "       Input may be FASTQ or SAM, plain or gzip compressed; - reads from stdin\n");
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
+    // the input file and optionally -o and the output file
+    if (argc != 2 && argc != 4) {
         reportHelp(argv[0]);
         return -1;
     }
     std::string inputfilepath = argv[1];
 
-    SeqFileType inputfiletype = endsWith(inputfilepath, ".fastq") ? FASTQ : SAM;
-
-    FILE *in = NULL;
-    if (inputfilepath.compare("-") == 0) {
-        inputfiletype = FASTQ;
-        in = stdin;
-    }
-    else {
-        in = fopen(inputfilepath.c_str(), "r");
-    }
-    if (in == NULL) {
+    SeqInput in;
+    if (!in.open(inputfilepath)) {
         fprintf(stderr, "Unable to open input file: %s - [%s]\n", inputfilepath.c_str(), strerror(errno));
         return -1;
     }
+    SeqFileType inputfiletype = in.fileType();
+    if (inputfiletype == BAM) {
+        fprintf(stderr, "BAM input is not supported: %s - convert with 'samtools view -h' first\n", inputfilepath.c_str());
+        return -1;
+    }
     FILE *out = stdout;
     if (argc >= 3) {
         std::string cmdopt = argv[2];
@@ -88,17 +147,17 @@ int main(int argc, char *argv[]) {
         }
     }
     char line[65536];
-    while (fgets(line, sizeof(line), in)) {
+    while (in.gets(line, sizeof(line))) {
         if (inputfiletype == FASTQ) {
             // read the other two lines
             for (int i = 0; i < 2; ++i) {
-                if (!fgets(line, sizeof(line), in)) {
+                if (!in.gets(line, sizeof(line))) {
                     fprintf(stderr, "Failed to read fastq entry: %s\n", line);
                     return -1;
                 }
             }
             // retrieve the qscore line
-            if (!fgets(line, sizeof(line), in)) {
+            if (!in.gets(line, sizeof(line))) {
                 fprintf(stderr, "Failed to read fastq entry: %s\n", line);
                 return -1;
             }
@@ -132,7 +191,7 @@ int main(int argc, char *argv[]) {
             pos++;
         }
     }
-    fclose(in);
+    in.close();
     if (out != stdout)
         fclose(out);
     return 0;
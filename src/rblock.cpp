@@ -38,20 +38,247 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
 #include <string>
 #include <math.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <glob.h>
+#include <sys/time.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
-enum SeqFileType { SAM, FASTQ };
+enum SeqFileType { SAM, FASTQ, BAM };
 
 using namespace std;
 
-bool endsWith(const string& base, const string& pattern) {
-    if (base.length() < pattern.length())
-        return false;
-    return (base.substr(base.length() - pattern.length()).compare(pattern) == 0);
+// Reads lines of a plain or gzip/bgzip compressed file, or of stdin when the path is "-".
+// The first line is read ahead on open so that the format can be detected from the content
+// rather than from the file extension.
+class SeqInput {
+protected:
+    gzFile file;
+    char head[65536];
+    bool hasHead;
+
+public:
+    SeqInput() {
+        file = NULL;
+        hasHead = false;
+    }
+
+    ~SeqInput() {
+        close();
+    }
+
+    bool open(const std::string &path) {
+        int fd = (path.compare("-") == 0) ? dup(STDIN_FILENO) : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        file = gzdopen(fd, "rb");
+        if (file == NULL) {
+            ::close(fd);
+            return false;
+        }
+        gzbuffer(file, 1024*1024);
+        hasHead = (gzgets(file, head, sizeof(head)) != NULL);
+        return true;
+    }
+
+    void close() {
+        if (file != NULL)
+            gzclose(file);
+        file = NULL;
+    }
+
+    // SAM header lines are '@' followed by a two letter record type and a tab (@HD, @SQ, @PG, ...)
+    // whereas FASTQ entries are '@' followed by the read name. Headerless SAM falls through to SAM.
+    SeqFileType fileType() const {
+        if (!hasHead)
+            return SAM;
+        if (memcmp(head, "BAM\1", 4) == 0)
+            return BAM;
+        if (head[0] != '@')
+            return SAM;
+        if (isupper(head[1]) && isalpha(head[2]) && head[3] == '\t')
+            return SAM;
+        return FASTQ;
+    }
+
+    char *gets(char *buf, int len) {
+        if (hasHead) {
+            hasHead = false;
+            snprintf(buf, len, "%s", head);
+            return buf;
+        }
+        return gzgets(file, buf, len);
+    }
+};
+
+#define CRC32C_POLY 0x82f63b78
+
+// CRC32C (Castagnoli) tables; hardware is set when the CPU has the SSE4.2 crc32 instruction
+struct CRC32CTables {
+    uint32_t table[256];
+    uint32_t x2n[32];   // x^(2^n) modulo the polynomial, for combining CRCs
+    bool hardware;
+
+    CRC32CTables() {
+        for (uint32_t i=0; i<256; ++i) {
+            uint32_t c = i;
+            for (int k=0; k<8; ++k)
+                c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+            table[i] = c;
+        }
+        uint32_t p = 1u << 30; // x^1
+        x2n[0] = p;
+        for (int n=1; n<32; ++n)
+            x2n[n] = p = multModP(p, p);
+#if defined(__x86_64__)
+        hardware = __builtin_cpu_supports("sse4.2");
+#else
+        hardware = false;
+#endif
+    }
+
+    // a*b modulo the polynomial, in the reflected bit order of the CRC
+    static uint32_t multModP(uint32_t a, uint32_t b) {
+        uint32_t m = 1u << 31, p = 0;
+        while (m != 0) {
+            if (a & m) {
+                p ^= b;
+                if ((a & (m - 1)) == 0)
+                    break;
+            }
+            m >>= 1;
+            b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+        }
+        return p;
+    }
+};
+
+const CRC32CTables &crc32cTables() {
+    static CRC32CTables tables;
+    return tables;
 }
 
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(uint32_t crc, const uint8_t *buf, size_t len) {
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        buf += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (len-- > 0)
+        crc = _mm_crc32_u8(crc, *buf++);
+    return crc;
+}
+#endif
+
+// running CRC32C of buf appended to crc (start with 0), same convention as zlib's crc32()
+uint32_t crc32c(uint32_t crc, const char *buf, size_t len) {
+    const CRC32CTables &tables = crc32cTables();
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (tables.hardware)
+        return ~crc32cHardware(crc, (const uint8_t *)buf, len);
+#endif
+    const uint8_t *p = (const uint8_t *)buf;
+    while (len-- > 0)
+        crc = tables.table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// CRC32C of A followed by B, given the CRCs of both and the length of B
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t lenB) {
+    const CRC32CTables &tables = crc32cTables();
+    uint32_t p = 1u << 31; // x^0
+    unsigned int k = 3;    // lenB is in bytes, i.e. x^(8*lenB)
+    while (lenB != 0) {
+        if (lenB & 1)
+            p = CRC32CTables::multModP(tables.x2n[k & 31], p);
+        lenB >>= 1;
+        k++;
+    }
+    return CRC32CTables::multModP(p, crcA) ^ crcB;
+}
+
+// CRC32C digests of the non-quality content and of the quality scores, before and after
+// quantisation. The non-quality digests of input and output must match.
+struct QualDigest {
+    enum { INPUT_OTHER, OUTPUT_OTHER, INPUT_QUAL, OUTPUT_QUAL, NUM_STREAMS };
+    uint32_t crc[NUM_STREAMS];
+    uint64_t len[NUM_STREAMS];
+
+    QualDigest() {
+        for (int i=0; i<NUM_STREAMS; ++i) {
+            crc[i] = 0;
+            len[i] = 0;
+        }
+    }
+
+    void add(int stream, const char *buf, size_t bufLen) {
+        crc[stream] = crc32c(crc[stream], buf, bufLen);
+        len[stream] += bufLen;
+    }
+
+    // add a line of the input or output, of which qualLen characters at qualStr are quality scores
+    void addLine(bool output, const char *line, size_t lineLen, const char *qualStr, unsigned int qualLen) {
+        int other = output ? OUTPUT_OTHER : INPUT_OTHER;
+        if (qualLen == 0) {
+            add(other, line, lineLen);
+            return;
+        }
+        add(other, line, qualStr-line);
+        add(output ? OUTPUT_QUAL : INPUT_QUAL, qualStr, qualLen);
+        add(other, qualStr+qualLen, lineLen - (qualStr-line) - qualLen);
+    }
+
+    // append the digests of content that follows the content digested so far
+    void append(const QualDigest &X) {
+        for (int i=0; i<NUM_STREAMS; ++i) {
+            crc[i] = crc32cCombine(crc[i], X.crc[i], X.len[i]);
+            len[i] += X.len[i];
+        }
+    }
+
+    bool otherUnchanged() const {
+        return crc[INPUT_OTHER] == crc[OUTPUT_OTHER] && len[INPUT_OTHER] == len[OUTPUT_OTHER];
+    }
+
+    bool write(const std::string &path, const char *tool, const std::string &inputPath, const std::string &outputPath) const {
+        FILE *out = fopen(path.c_str(), "w");
+        if (out == NULL)
+            return false;
+        const char *names[NUM_STREAMS] = { "input_nonqual", "output_nonqual", "input_qual", "output_qual" };
+        fprintf(out, "# CRC32C digests written by %s\n", tool);
+        fprintf(out, "input\t%s\n", inputPath.c_str());
+        fprintf(out, "output\t%s\n", outputPath.c_str());
+        for (int i=0; i<NUM_STREAMS; ++i)
+            fprintf(out, "%s\t%08x\t%" PRIu64 "\n", names[i], crc[i], len[i]);
+        fprintf(out, "nonqual_unchanged\t%s\n", otherUnchanged() ? "YES" : "NO");
+        return fclose(out) == 0;
+    }
+};
+
 
 void rblock(char *buf, unsigned int bufLen, double theta) {
     unsigned int minVal = buf[0];
@@ -94,79 +321,805 @@ void rblock(char *buf, unsigned int bufLen, double theta) {
     }
 }
 
+#define NUM_QUALS 94 // phred+33 printable range '!'..'~'
+
+// Distortion of quantised quality scores against the originals. Only the confusion matrix of
+// input versus output phred scores is counted per base, all other measures derive from it.
+struct QualDistortion {
+    uint64_t confusion[NUM_QUALS][NUM_QUALS]; // [input][output]
+
+    QualDistortion() {
+        memset(confusion, 0, sizeof(confusion));
+    }
+
+    static unsigned int clampQual(int qual) {
+        if (qual < 0)
+            return 0;
+        if (qual >= NUM_QUALS)
+            return NUM_QUALS-1;
+        return qual;
+    }
+
+    void add(int inputQual, int outputQual) {
+        confusion[clampQual(inputQual)][clampQual(outputQual)]++;
+    }
+
+    void append(const QualDistortion &X) {
+        for (unsigned int i=0; i<NUM_QUALS; ++i)
+            for (unsigned int j=0; j<NUM_QUALS; ++j)
+                confusion[i][j] += X.confusion[i][j];
+    }
+
+    // count, mean squared and absolute error per base, maximum absolute error and maximum error
+    // relative to the input score (inputs of 0 are left out of the relative error)
+    void summarise(uint64_t *count, double *mse, double *mae, unsigned int *maxAbsError, double *maxRelError) const {
+        uint64_t sumSq = 0, sumAbs = 0;
+        *count = 0;
+        *maxAbsError = 0;
+        *maxRelError = 0.0;
+        for (unsigned int i=0; i<NUM_QUALS; ++i) {
+            for (unsigned int j=0; j<NUM_QUALS; ++j) {
+                uint64_t n = confusion[i][j];
+                if (n == 0)
+                    continue;
+                unsigned int absError = (i > j) ? i-j : j-i;
+                *count += n;
+                sumAbs += n * absError;
+                sumSq += n * absError * absError;
+                if (absError > *maxAbsError)
+                    *maxAbsError = absError;
+                if (i > 0 && (double)absError / (double)i > *maxRelError)
+                    *maxRelError = (double)absError / (double)i;
+            }
+        }
+        *mse = (*count > 0) ? (double)sumSq / (double)*count : 0.0;
+        *mae = (*count > 0) ? (double)sumAbs / (double)*count : 0.0;
+    }
+
+    bool write(const std::string &path, const char *tool, const std::string &params, const std::string &inputPath) const {
+        FILE *out = fopen(path.c_str(), "w");
+        if (out == NULL)
+            return false;
+        uint64_t count;
+        double mse, mae, maxRelError;
+        unsigned int maxAbsError;
+        summarise(&count, &mse, &mae, &maxAbsError, &maxRelError);
+        fprintf(out, "# quality score distortion written by %s%s%s\n", tool, params.empty() ? "" : " ", params.c_str());
+        fprintf(out, "input\t%s\n", inputPath.c_str());
+        fprintf(out, "bases\t%" PRIu64 "\n", count);
+        fprintf(out, "mse\t%lf\n", mse);
+        fprintf(out, "mae\t%lf\n", mae);
+        fprintf(out, "max_abs_error\t%u\n", maxAbsError);
+        fprintf(out, "max_rel_error\t%lf\n", maxRelError);
+        fprintf(out, "# confusion: input phred, output phred, number of bases\n");
+        for (unsigned int i=0; i<NUM_QUALS; ++i)
+            for (unsigned int j=0; j<NUM_QUALS; ++j)
+                if (confusion[i][j] != 0)
+                    fprintf(out, "confusion\t%u\t%u\t%" PRIu64 "\n", i, j, confusion[i][j]);
+        return fclose(out) == 0;
+    }
+};
+
+// quantise a phred+33 quality string of qualLen characters in place
+void rblockQuals(char *qualStr, unsigned int qualLen, double theta, QualDistortion *distortion) {
+    char buffer[65536];
+    std::vector<char> longQuals; // lines of batch mode are read whole and may be longer than buffer
+    if (qualLen == 0)
+        return;
+    char *quals = buffer;
+    if (qualLen > sizeof(buffer)) {
+        longQuals.resize(qualLen);
+        quals = &longQuals[0];
+    }
+    for (unsigned int idx=0; idx<qualLen; ++idx)
+        quals[idx] = qualStr[idx]-33;
+    rblock(quals, qualLen, theta);
+    for (unsigned int idx=0; idx<qualLen; ++idx) {
+        if (distortion != NULL)
+            distortion->add(qualStr[idx]-33, quals[idx]);
+        qualStr[idx] = quals[idx]+33;
+    }
+}
+
+// locate the QUAL column (11th) of a SAM alignment line, returns its length or 0 if it has none
+unsigned int samQualColumn(char *line, unsigned int lineLen, char **qualStr) {
+    bool wasWhitespace = true;
+    unsigned int colNum=0, colStartPos=0, pos=0;
+    while (pos <= lineLen) {
+        bool endOfLine = (pos == lineLen || line[pos] == 0 || line[pos] == '\n' || line[pos] == '\r');
+        bool whitespace = (endOfLine || line[pos] == ' ' or line[pos] == '\t');
+        if (whitespace && !wasWhitespace) {
+            wasWhitespace = true;
+            if (colNum == 11) {
+                *qualStr = line+colStartPos;
+                return pos-colStartPos;
+            }
+        }
+        else if (!whitespace && wasWhitespace) {
+            colNum++;
+            colStartPos = pos;
+            wasWhitespace = false;
+        }
+        if (endOfLine)
+            break;
+        pos++;
+    }
+    return 0;
+}
+
+// write out a line that is not modified, adding it to both the input and output digests
+void writeLine(const char *line, FILE *out, QualDigest *digest) {
+    if (digest != NULL) {
+        size_t lineLen = strlen(line);
+        digest->addLine(false, line, lineLen, line, 0);
+        digest->addLine(true, line, lineLen, line, 0);
+    }
+    fputs(line, out);
+}
+
+#define BATCH_BLOCK_SIZE (1024*1024)
+#define BATCH_MAX_IN_FLIGHT 8
+
+double wallTime() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+struct BatchFile;
+
+// a run of complete FASTQ entries or SAM lines from one input file
+struct BatchBlock {
+    BatchFile *file;
+    uint64_t seq;
+    std::string data;
+    uint64_t records;
+    uint64_t quals;
+    QualDigest digest;
+    QualDistortion *distortion;
+
+    BatchBlock(BatchFile *parent) {
+        file = parent;
+        distortion = NULL;
+        seq = 0;
+        records = 0;
+        quals = 0;
+    }
+
+    ~BatchBlock() {
+        delete distortion;
+    }
+};
+
+struct BatchFile {
+    std::string inputPath;
+    std::string outputPath;
+    SeqInput in;
+    SeqFileType fileType;
+    FILE *out;
+
+    // guards everything below
+    std::mutex lock;
+    std::map<uint64_t, BatchBlock *> quantized; // blocks waiting for their turn to be written
+    uint64_t nextReadSeq;
+    uint64_t nextWriteSeq;
+    unsigned int inFlight;
+    bool readPaused;
+    bool readDone;
+    bool writing;
+    bool done;
+    bool failed;
+    uint64_t records;
+    uint64_t quals;
+    uint64_t bytes;
+    QualDigest digest;
+    QualDistortion *distortion;
+    double startTime;
+    double endTime;
+
+    BatchFile() {
+        fileType = SAM;
+        out = NULL;
+        distortion = NULL;
+        nextReadSeq = 0;
+        nextWriteSeq = 0;
+        inFlight = 0;
+        readPaused = false;
+        readDone = false;
+        writing = false;
+        done = false;
+        failed = false;
+        records = 0;
+        quals = 0;
+        bytes = 0;
+        startTime = 0.0;
+        endTime = 0.0;
+    }
+
+    ~BatchFile() {
+        delete distortion;
+    }
+};
+
+enum BatchTaskType { READ_BLOCK, QUANTIZE_BLOCK };
+
+struct BatchTask {
+    BatchTaskType type;
+    BatchFile *file;
+    BatchBlock *block;
+};
+
+// Quantises many input files on one thread pool. Each file is read block by block, and the
+// blocks of all open files are scheduled as independent tasks so that small and large files
+// share the cores. Every worker pushes and pops its own tasks at the back of its deque, idle
+// workers steal from the front of the others. Blocks are written back in input order.
+class BatchQuantizer {
+protected:
+    struct Worker {
+        std::mutex lock;
+        std::deque<BatchTask> tasks;
+    };
+
+    double theta;
+    std::vector<BatchFile *> files;
+    std::vector<Worker *> workers;
+    std::mutex poolLock;
+    std::condition_variable poolWake;
+    int queued;              // tasks sitting in a deque
+    unsigned int pending;    // tasks queued or running
+    std::mutex filesLock;
+    unsigned int nextFile;
+    bool digests;
+    bool distortions;
+    std::string params;  // quantiser parameters for the distortion reports
+
+    void push(unsigned int self, BatchTaskType type, BatchFile *file, BatchBlock *block) {
+        BatchTask task;
+        task.type = type;
+        task.file = file;
+        task.block = block;
+        {
+            std::lock_guard<std::mutex> guard(poolLock);
+            pending++;
+        }
+        {
+            std::lock_guard<std::mutex> guard(workers[self]->lock);
+            workers[self]->tasks.push_back(task);
+        }
+        std::lock_guard<std::mutex> guard(poolLock);
+        queued++;
+        poolWake.notify_one();
+    }
+
+    bool pop(unsigned int self, BatchTask &task) {
+        for (unsigned int i=0; i<workers.size(); ++i) {
+            Worker *worker = workers[(self+i) % workers.size()];
+            std::lock_guard<std::mutex> guard(worker->lock);
+            if (worker->tasks.empty())
+                continue;
+            if (i == 0) {
+                task = worker->tasks.back();
+                worker->tasks.pop_back();
+            }
+            else {
+                task = worker->tasks.front();
+                worker->tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned int self) {
+        while (true) {
+            BatchTask task;
+            if (pop(self, task)) {
+                {
+                    std::lock_guard<std::mutex> guard(poolLock);
+                    queued--;
+                }
+                if (task.type == READ_BLOCK)
+                    readBlock(self, task.file);
+                else
+                    quantizeBlock(self, task.block);
+                std::lock_guard<std::mutex> guard(poolLock);
+                if (--pending == 0)
+                    poolWake.notify_all();
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(poolLock);
+            if (pending == 0)
+                return;
+            if (queued <= 0)
+                poolWake.wait(guard);
+        }
+    }
+
+    // opens the next input file of the batch and schedules its first block
+    void openNextFile(unsigned int self) {
+        while (true) {
+            BatchFile *file;
+            {
+                std::lock_guard<std::mutex> guard(filesLock);
+                if (nextFile >= files.size())
+                    return;
+                file = files[nextFile++];
+            }
+            file->startTime = wallTime();
+            if (!file->in.open(file->inputPath)) {
+                fprintf(stderr, "Unable to open input file: %s [%s]\n", file->inputPath.c_str(), strerror(errno));
+                file->failed = true;
+                continue;
+            }
+            file->fileType = file->in.fileType();
+            if (file->fileType == BAM) {
+                fprintf(stderr, "BAM input is not supported: %s - convert with 'samtools view -h' first\n", file->inputPath.c_str());
+                file->failed = true;
+                continue;
+            }
+            file->out = fopen(file->outputPath.c_str(), "w");
+            if (file->out == NULL) {
+                fprintf(stderr, "Unable to open output file: %s [%s]\n", file->outputPath.c_str(), strerror(errno));
+                file->failed = true;
+                continue;
+            }
+            if (distortions)
+                file->distortion = new QualDistortion();
+            push(self, READ_BLOCK, file, NULL);
+            return;
+        }
+    }
+
+    // called with file->lock held once every block of the file has been written
+    void finishFile(unsigned int self, BatchFile *file) {
+        if (file->done)
+            return;
+        file->done = true;
+        file->in.close();
+        if (fclose(file->out) != 0 && !file->failed) {
+            fprintf(stderr, "Unable to write output file: %s [%s]\n", file->outputPath.c_str(), strerror(errno));
+            file->failed = true;
+        }
+        file->out = NULL;
+        if (digests && !file->failed) {
+            std::string digestPath = file->outputPath + ".crc32c";
+            if (!file->digest.write(digestPath, "rblock", file->inputPath, file->outputPath)) {
+                fprintf(stderr, "Unable to write digest file: %s [%s]\n", digestPath.c_str(), strerror(errno));
+                file->failed = true;
+            }
+            else if (!file->digest.otherUnchanged()) {
+                fprintf(stderr, "Non-quality content differs between input and output: %s\n", file->inputPath.c_str());
+                file->failed = true;
+            }
+        }
+        if (distortions && !file->failed) {
+            std::string distortionPath = file->outputPath + ".distortion";
+            if (!file->distortion->write(distortionPath, "rblock", params, file->inputPath)) {
+                fprintf(stderr, "Unable to write distortion file: %s [%s]\n", distortionPath.c_str(), strerror(errno));
+                file->failed = true;
+            }
+        }
+        file->endTime = wallTime();
+        openNextFile(self);
+    }
+
+    void readBlock(unsigned int self, BatchFile *file) {
+        BatchBlock *block = new BatchBlock(file);
+        if (distortions)
+            block->distortion = new QualDistortion();
+        block->data.reserve(BATCH_BLOCK_SIZE + 4*65536);
+        char line[65536];
+        bool eof = false, failed = false;
+        while (block->data.size() < BATCH_BLOCK_SIZE) {
+            if (!file->in.gets(line, sizeof(line))) {
+                eof = true;
+                break;
+            }
+            block->data.append(line);
+            if (file->fileType != FASTQ)
+                continue;
+            // keep the remaining three lines of the fastq entry in the same block
+            for (int i = 0; i < 3; ++i) {
+                if (!file->in.gets(line, sizeof(line))) {
+                    fprintf(stderr, "Failed to read fastq entry in %s: %s\n", file->inputPath.c_str(), line);
+                    eof = failed = true;
+                    break;
+                }
+                block->data.append(line);
+            }
+            if (eof)
+                break;
+        }
+
+        std::lock_guard<std::mutex> guard(file->lock);
+        if (failed)
+            file->failed = true;
+        if (!block->data.empty()) {
+            block->seq = file->nextReadSeq++;
+            file->inFlight++;
+            push(self, QUANTIZE_BLOCK, file, block);
+        }
+        else {
+            delete block;
+        }
+        if (eof) {
+            file->readDone = true;
+            if (file->inFlight == 0)
+                finishFile(self, file);
+        }
+        else if (file->inFlight < BATCH_MAX_IN_FLIGHT) {
+            push(self, READ_BLOCK, file, NULL);
+        }
+        else {
+            file->readPaused = true;
+        }
+    }
+
+    void quantizeBlock(unsigned int self, BatchBlock *block) {
+        BatchFile *file = block->file;
+        char *line = &block->data[0];
+        char *end = line + block->data.size();
+        unsigned int lineNum = 0;
+        while (line < end) {
+            char *eol = (char *)memchr(line, '\n', end-line);
+            if (eol == NULL)
+                eol = end;
+            char *qualStr = line;
+            unsigned int qualLen = 0;
+            if (file->fileType == FASTQ) {
+                if (lineNum % 4 == 3) {
+                    qualLen = eol-line;
+                    block->records++;
+                }
+            }
+            else if (line[0] != '@') {
+                qualLen = samQualColumn(line, eol-line, &qualStr);
+                block->records++;
+            }
+            size_t lineLen = (eol < end) ? eol+1-line : eol-line;
+            if (digests)
+                block->digest.addLine(false, line, lineLen, qualStr, qualLen);
+            rblockQuals(qualStr, qualLen, theta, block->distortion);
+            if (digests)
+                block->digest.addLine(true, line, lineLen, qualStr, qualLen);
+            block->quals += qualLen;
+            lineNum++;
+            line = eol+1;
+        }
+
+        // whoever finds the file idle writes out every block that is next in line
+        std::unique_lock<std::mutex> guard(file->lock);
+        file->quantized[block->seq] = block;
+        if (file->writing)
+            return;
+        file->writing = true;
+        std::map<uint64_t, BatchBlock *>::iterator it;
+        while ((it = file->quantized.find(file->nextWriteSeq)) != file->quantized.end()) {
+            BatchBlock *next = it->second;
+            file->quantized.erase(it);
+            guard.unlock();
+            bool written = (fwrite(next->data.data(), 1, next->data.size(), file->out) == next->data.size());
+            guard.lock();
+            if (!written && !file->failed) {
+                fprintf(stderr, "Unable to write output file: %s [%s]\n", file->outputPath.c_str(), strerror(errno));
+                file->failed = true;
+            }
+            file->records += next->records;
+            file->quals += next->quals;
+            file->bytes += next->data.size();
+            if (digests)
+                file->digest.append(next->digest);
+            if (next->distortion != NULL)
+                file->distortion->append(*next->distortion);
+            delete next;
+            file->nextWriteSeq++;
+            file->inFlight--;
+            if (file->readPaused) {
+                file->readPaused = false;
+                push(self, READ_BLOCK, file, NULL);
+            }
+        }
+        file->writing = false;
+        if (file->readDone && file->inFlight == 0)
+            finishFile(self, file);
+    }
+
+public:
+    BatchQuantizer(double theta) {
+        this->theta = theta;
+        queued = 0;
+        pending = 0;
+        nextFile = 0;
+        digests = false;
+        distortions = false;
+    }
+
+    ~BatchQuantizer() {
+        for (unsigned int i=0; i<files.size(); ++i)
+            delete files[i];
+        for (unsigned int i=0; i<workers.size(); ++i)
+            delete workers[i];
+    }
+
+    // write a <output>.crc32c sidecar of integrity digests for every file
+    void setDigests(bool enable) {
+        digests = enable;
+    }
+
+    // write a <output>.distortion report of quality score distortion for every file
+    void setDistortion(bool enable, const std::string &params) {
+        distortions = enable;
+        this->params = params;
+    }
+
+    void addFile(const std::string &inputPath, const std::string &outputPath) {
+        BatchFile *file = new BatchFile();
+        file->inputPath = inputPath;
+        file->outputPath = outputPath;
+        files.push_back(file);
+    }
+
+    // returns true if every file was quantised without error
+    bool run(unsigned int numThreads) {
+        if (numThreads == 0)
+            numThreads = 1;
+        for (unsigned int i=0; i<numThreads; ++i)
+            workers.push_back(new Worker());
+        double startTime = wallTime();
+        // keep about one open file per thread, finished files hand over to the next one
+        for (unsigned int i=0; i<numThreads; ++i)
+            openNextFile(0);
+        std::vector<std::thread> threads;
+        for (unsigned int i=0; i<numThreads; ++i)
+            threads.push_back(std::thread(&BatchQuantizer::workerLoop, this, i));
+        for (unsigned int i=0; i<numThreads; ++i)
+            threads[i].join();
+        double seconds = wallTime() - startTime;
+
+        bool success = true;
+        uint64_t records = 0, quals = 0, bytes = 0;
+        QualDistortion distortion;
+        for (unsigned int i=0; i<files.size(); ++i) {
+            BatchFile *file = files[i];
+            if (file->failed)
+                success = false;
+            fprintf(stderr, "%s -> %s: %s, %" PRIu64 " records, %" PRIu64 " quality scores, %" PRIu64 " bytes, %.2lf s\n",
+                    file->inputPath.c_str(), file->outputPath.c_str(), file->failed ? "FAILED" : "OK",
+                    file->records, file->quals, file->bytes, file->done ? file->endTime - file->startTime : 0.0);
+            records += file->records;
+            quals += file->quals;
+            bytes += file->bytes;
+            if (file->distortion != NULL)
+                distortion.append(*file->distortion);
+        }
+        fprintf(stderr, "TOTAL: %u files, %" PRIu64 " records, %" PRIu64 " quality scores, %" PRIu64 " bytes, %.2lf s, %.2lf MB/s, %u threads\n",
+                (unsigned int)files.size(), records, quals, bytes, seconds, seconds > 0.0 ? (double)bytes / seconds / 1048576.0 : 0.0, numThreads);
+        if (distortions) {
+            uint64_t count;
+            double mse, mae, maxRelError;
+            unsigned int maxAbsError;
+            distortion.summarise(&count, &mse, &mae, &maxAbsError, &maxRelError);
+            fprintf(stderr, "DISTORTION: %" PRIu64 " bases, MSE = %lf, MAE = %lf, max abs error = %u, max rel error = %lf\n",
+                    count, mse, mae, maxAbsError, maxRelError);
+        }
+        return success;
+    }
+};
+
+// output path for an input of a glob batch: same file name in the output directory, minus any .gz
+std::string batchOutputPath(const std::string &outputDir, const std::string &inputPath) {
+    std::string name = inputPath;
+    size_t slash = name.rfind('/');
+    if (slash != std::string::npos)
+        name = name.substr(slash+1);
+    if (name.size() > 3 && name.compare(name.size()-3, 3, ".gz") == 0)
+        name.resize(name.size()-3);
+    return outputDir + "/" + name;
+}
+
+// fills the batch from a manifest of "input [output]" lines, or from a glob of inputs
+bool loadBatch(BatchQuantizer &batch, const std::string &spec, const std::string &outputDir) {
+    std::vector<std::string> inputs, outputs;
+    if (spec.find_first_of("*?[") != std::string::npos) {
+        glob_t globbuf;
+        if (glob(spec.c_str(), 0, NULL, &globbuf) != 0) {
+            fprintf(stderr, "No input files match: %s\n", spec.c_str());
+            return false;
+        }
+        for (size_t i=0; i<globbuf.gl_pathc; ++i) {
+            inputs.push_back(globbuf.gl_pathv[i]);
+            outputs.push_back("");
+        }
+        globfree(&globbuf);
+    }
+    else {
+        FILE *manifest = fopen(spec.c_str(), "r");
+        if (manifest == NULL) {
+            fprintf(stderr, "Unable to open manifest file: %s [%s]\n", spec.c_str(), strerror(errno));
+            return false;
+        }
+        char line[65536];
+        while (fgets(line, sizeof(line), manifest)) {
+            char *saveptr;
+            char *input = strtok_r(line, " \t\r\n", &saveptr);
+            if (input == NULL || input[0] == '#')
+                continue;
+            char *output = strtok_r(NULL, " \t\r\n", &saveptr);
+            inputs.push_back(input);
+            outputs.push_back(output != NULL ? output : "");
+        }
+        fclose(manifest);
+    }
+    // every output is written by one worker and none overwrites an input
+    std::set<std::string> inputSet(inputs.begin(), inputs.end()), outputSet;
+    for (size_t i=0; i<inputs.size(); ++i) {
+        if (outputs[i].empty()) {
+            if (outputDir.empty()) {
+                fprintf(stderr, "No output path for %s - give one in the manifest or use -O /output/dir\n", inputs[i].c_str());
+                return false;
+            }
+            outputs[i] = batchOutputPath(outputDir, inputs[i]);
+        }
+        if (inputSet.count(outputs[i]) != 0) {
+            fprintf(stderr, "Output path is the same as an input path: %s\n", outputs[i].c_str());
+            return false;
+        }
+        if (!outputSet.insert(outputs[i]).second) {
+            fprintf(stderr, "Output path is the same for more than one input: %s\n", outputs[i].c_str());
+            return false;
+        }
+        batch.addFile(inputs[i], outputs[i]);
+    }
+    return true;
+}
+
+void printHelp(const char *argv0) {
+    fprintf(stderr, "Usage: %s [filename | -] [theta] [-d /path/to/digest/filename] [-m /path/to/distortion/filename]\n", argv0);
+    fprintf(stderr, "       %s -b [manifest | \"glob\"] [theta] [-O /output/dir] [-t threads] [-d] [-m]\n", argv0);
+    fprintf(stderr, "       Input may be FASTQ or SAM, plain or gzip compressed; - reads from stdin\n");
+    fprintf(stderr, "       Batch mode takes a manifest with one \"input [output]\" pair per line, or a quoted\n");
+    fprintf(stderr, "       glob of inputs written to the same file names in the output directory\n");
+    fprintf(stderr, "       -d writes CRC32C digests of the non-quality content and of the quality scores of\n");
+    fprintf(stderr, "       input and output (in batch mode to <output>.crc32c)\n");
+    fprintf(stderr, "       -m writes MSE, MAE, maximum absolute and relative error and the confusion matrix of\n");
+    fprintf(stderr, "       input versus output quality scores (in batch mode to <output>.distortion)\n");
+}
+
+int runBatch(int argc, char *argv[]) {
+    if (argc < 4) {
+        printHelp(argv[0]);
+        return -1;
+    }
+    std::string spec = argv[2];
+    double theta = atof(argv[3]);
+    std::string outputDir;
+    unsigned int numThreads = std::thread::hardware_concurrency();
+    bool digests = false, distortions = false;
+    for (int i=4; i<argc; ++i) {
+        if (strcmp(argv[i], "-d") == 0) {
+            digests = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-m") == 0) {
+            distortions = true;
+            continue;
+        }
+        if (i+1 >= argc || (strcmp(argv[i], "-O") != 0 && strcmp(argv[i], "-t") != 0)) {
+            fprintf(stderr, "Invalid command option: %s\n", argv[i]);
+            printHelp(argv[0]);
+            return -1;
+        }
+        if (strcmp(argv[i], "-O") == 0)
+            outputDir = argv[i+1];
+        else
+            numThreads = atoi(argv[i+1]);
+        ++i;
+    }
+    BatchQuantizer batch(theta);
+    batch.setDigests(digests);
+    batch.setDistortion(distortions, std::string("theta=") + argv[3]);
+    if (!loadBatch(batch, spec, outputDir))
+        return -1;
+    return batch.run(numThreads) ? 0 : -1;
+}
+
 int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "-b") == 0)
+        return runBatch(argc, argv);
     if (argc <3) {
-        fprintf(stderr, "Usage: %s [filename] [theta]\n", argv[0]);
+        printHelp(argv[0]);
         return 0;
     }
     std::string inputfilepath = argv[1];
     double theta = atof(argv[2]);
-    SeqFileType inputfiletype = endsWith(inputfilepath, ".fastq") ? FASTQ : SAM;
+    std::string digestPath, distortionPath;
+    for (int i=3; i<argc; ++i) {
+        if ((strcmp(argv[i], "-d") != 0 && strcmp(argv[i], "-m") != 0) || i+1 >= argc) {
+            fprintf(stderr, "Invalid command option: %s\n", argv[i]);
+            printHelp(argv[0]);
+            return -1;
+        }
+        if (strcmp(argv[i], "-d") == 0)
+            digestPath = argv[++i];
+        else
+            distortionPath = argv[++i];
+    }
+    QualDigest digest;
+    QualDigest *lineDigest = digestPath.empty() ? NULL : &digest;
+    QualDistortion *lineDistortion = distortionPath.empty() ? NULL : new QualDistortion();
 
-    FILE *in = fopen(argv[1], "r");
-    if (in == NULL) {
+    SeqInput in;
+    if (!in.open(inputfilepath)) {
         fprintf(stderr, "Unable to open input file: %s [%s]\n", argv[1], strerror(errno));
         return -1;
     }
-    char line[65536], quals[65536];
-    while (fgets(line, sizeof(line), in)) {
+    SeqFileType inputfiletype = in.fileType();
+    if (inputfiletype == BAM) {
+        fprintf(stderr, "BAM input is not supported: %s - convert with 'samtools view -h' first\n", argv[1]);
+        return -1;
+    }
+    char line[65536];
+    while (in.gets(line, sizeof(line))) {
         if (inputfiletype == FASTQ) {
             // write the first line to the output
-            fputs(line, stdout);
+            writeLine(line, stdout, lineDigest);
             // write the other two lines to the output
             for (int i = 0; i < 2; ++i) {
-                if (!fgets(line, sizeof(line), in)) {
-                    printf("Failed to read fastq entry: %s\n", line);
+                if (!in.gets(line, sizeof(line))) {
+                    fprintf(stderr, "Failed to read fastq entry: %s\n", line);
                     return -1;
                 }
-                fputs(line, stdout);
+                writeLine(line, stdout, lineDigest);
             }
             // retrieve the qscore line
-            if (!fgets(line, sizeof(line), in)) {
-                printf("Failed to read fastq entry: %s\n", line);
+            if (!in.gets(line, sizeof(line))) {
+                fprintf(stderr, "Failed to read fastq entry: %s\n", line);
                 return -1;
             }
             // quantize
             unsigned int idx=0;
-            while (!(line[idx] == '\0' || line[idx] == '\n')) {
-                quals[idx] = line[idx]-33;
+            while (!(line[idx] == '\0' || line[idx] == '\n'))
                 ++idx;
-            }
-            rblock(quals, idx, theta);
-            for (unsigned int j=0; j<idx; ++j) {
-                line[j] = quals[j]+33;
-            }
+            if (lineDigest != NULL)
+                digest.addLine(false, line, strlen(line), line, idx);
+            rblockQuals(line, idx, theta, lineDistortion);
+            if (lineDigest != NULL)
+                digest.addLine(true, line, strlen(line), line, idx);
             // write out
             fputs(line, stdout);
             continue;
         }
 
         if (line[0] == '@') {
-            fputs(line, stdout);
+            writeLine(line, stdout, lineDigest);
             continue;
         }
-        bool wasWhitespace = true;
-        unsigned int colNum=0, colStartPos=0, pos=0;
-        while (line[pos]!=0) {
-            bool whitespace = (line[pos] == ' ' or line[pos] == '\t');
-            if (whitespace && !wasWhitespace) {
-                wasWhitespace = true;
-                if (colNum == 11) {
-                    for (unsigned int idx=colStartPos; idx<pos; ++idx)
-                        quals[idx-colStartPos] = line[idx]-33;
-                    rblock(quals, pos-colStartPos, theta);
-                    for (unsigned int idx=colStartPos; idx<pos; ++idx)
-                        line[idx] = quals[idx-colStartPos]+33;
-                }
-            }
-            else if (!whitespace && wasWhitespace) {
-                colNum++;
-                colStartPos = pos;
-                wasWhitespace = false;
-            }
-            pos++;
-        }
+        char *qualStr = line;
+        unsigned int qualLen = samQualColumn(line, strlen(line), &qualStr);
+        if (lineDigest != NULL)
+            digest.addLine(false, line, strlen(line), qualStr, qualLen);
+        rblockQuals(qualStr, qualLen, theta, lineDistortion);
+        if (lineDigest != NULL)
+            digest.addLine(true, line, strlen(line), qualStr, qualLen);
         fputs(line, stdout);
     }
+    if (lineDistortion != NULL) {
+        bool written = lineDistortion->write(distortionPath, "rblock", std::string("theta=") + argv[2], inputfilepath);
+        delete lineDistortion;
+        if (!written) {
+            fprintf(stderr, "Unable to write distortion file: %s [%s]\n", distortionPath.c_str(), strerror(errno));
+            return -1;
+        }
+    }
+    if (lineDigest != NULL) {
+        if (!digest.write(digestPath, "rblock", inputfilepath, "-")) {
+            fprintf(stderr, "Unable to write digest file: %s [%s]\n", digestPath.c_str(), strerror(errno));
+            return -1;
+        }
+        if (!digest.otherUnchanged()) {
+            fprintf(stderr, "Non-quality content differs between input and output: %s\n", inputfilepath.c_str());
+            return -1;
+        }
+    }
     return 0;
 }